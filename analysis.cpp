@@ -0,0 +1,400 @@
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "analysis.hpp"
+#include "player.hpp"
+#include "board.hpp"
+
+/*
+ * Batch analysis: positions come in on one stream, one per line, and each
+ * gets one line back with the best move, its score, the number of nodes
+ * searched and the principal variation, in the order the positions came in.
+ *
+ * A position line is
+ *
+ *     <position> <side to move> [depth=N] [time=MS]
+ *
+ * where the position is either 64 characters as Board::setBoard() takes them
+ * ('b', 'w', and '-' or '.' for empty squares, a1 first) or 32 hex digits,
+ * the black and then the white bitboard, and the side is b or w. Blank lines
+ * and lines starting with '#' are skipped. The answer is
+ *
+ *     move f5 score +1.25 type eval nodes 12345 pv f5 d6 c3
+ *
+ * for the side to move. Squares are a-h by file and 1-8 by row from the top;
+ * the move is "pass" if the side to move has none and "none" once the game
+ * is over. The type says what the score is: "eval" for an evaluation in
+ * discs, "exact" for the final disc difference with perfect play, and "wld"
+ * for a solved win (+1), draw (0) or loss (-1). A line that cannot be read
+ * gets "error <reason>" back instead.
+ *
+ * Each worker searches with its own single-threaded player, cleared before
+ * each position, so an untimed analysis gives the same answers whatever the
+ * number of workers.
+ */
+
+// Table size of each worker's player.
+#define ANALYSIS_HASH_MB 16
+
+// Search depth used unless changed.
+#define ANALYSIS_DEPTH 8
+
+// Most positions read ahead of the oldest one not yet written out, so that
+// one slow position does not hold up an unbounded amount of output.
+#define MAX_PENDING 1024
+
+AnalysisOptions::AnalysisOptions()
+    : workers(thread::hardware_concurrency()), depth(ANALYSIS_DEPTH),
+      ms(-1), hashMB(ANALYSIS_HASH_MB) {}
+
+// One position to analyse and how
+struct AnalysisRequest {
+    Board board;
+    Side side;
+    int depth;
+    long ms;
+};
+
+enum ScoreType { SCORE_EVAL, SCORE_EXACT, SCORE_WLD };
+
+// What the analysis of a position found; squares of the PV are -1 for passes
+struct AnalysisResult {
+    vector<int> pv;
+    int score;
+    ScoreType type;
+    long nodes;
+};
+
+/*
+ * Reads a bitboard written as 16 hex digits.
+ */
+static bool parseHex(const string &text, uint64_t &value) {
+    value = 0;
+    for (char c : text) {
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+static bool parsePosition(const string &text, Board &board) {
+    if (text.size() == 64) {
+        if (text.find_first_not_of("bw-.") != string::npos) return false;
+        board.setBoard(text.c_str());
+        return true;
+    }
+
+    uint64_t black, white;
+    if (text.size() != 32 || !parseHex(text.substr(0, 16), black) ||
+        !parseHex(text.substr(16), white) || (black & white)) {
+        return false;
+    }
+    string data(64, '-');
+    for (int i = 0; i < 64; i++) {
+        if (black & (1ULL << i)) data[i] = 'b';
+        if (white & (1ULL << i)) data[i] = 'w';
+    }
+    board.setBoard(data.c_str());
+    return true;
+}
+
+/*
+ * Reads a position line. Returns an empty string if it is fine and what is
+ * wrong with it otherwise.
+ */
+static string parseRequest(const string &line, const AnalysisOptions &options,
+                           AnalysisRequest &request) {
+    stringstream tokens(line);
+    string position, side;
+    if (!(tokens >> position >> side)) {
+        return "expected a position and a side";
+    }
+    if (!parsePosition(position, request.board)) return "bad position";
+    if (side == "b") request.side = BLACK;
+    else if (side == "w") request.side = WHITE;
+    else return "bad side " + side;
+
+    int depth = -1;
+    long ms = -1;
+    string option;
+    while (tokens >> option) {
+        if (option.compare(0, 6, "depth=") == 0) {
+            depth = atoi(option.c_str() + 6);
+            if (depth < 1) return "bad " + option;
+        }
+        else if (option.compare(0, 5, "time=") == 0) {
+            ms = atol(option.c_str() + 5);
+            if (ms < 1) return "bad " + option;
+        }
+        else return "unknown option " + option;
+    }
+
+    // A depth on the line makes the search untimed unless the line also
+    // gives a time.
+    request.depth = (depth > 0) ? depth : options.depth;
+    request.ms = (ms > 0) ? ms : (depth > 0) ? -1 : options.ms;
+    return "";
+}
+
+/*
+ * Follows the table's best moves from a position for as long as they are
+ * legal, passing where the side to move has to.
+ */
+static void extendPV(Player *player, Board board, Side side,
+                     vector<int> &pv) {
+    while (!board.isDone()) {
+        if (!board.hasMoves(side)) {
+            pv.push_back(-1);
+            side = opponentOf(side);
+            continue;
+        }
+
+        TTEntry entry;
+        if (!player->tt.probe(board.getHash(side), entry) || entry.move < 0)
+            break;
+        Move move(entry.move);
+        if (!board.checkMove(&move, side)) break;
+        board.doMove(&move, side);
+        pv.push_back(entry.move);
+        side = opponentOf(side);
+    }
+
+    while (!pv.empty() && pv.back() < 0) pv.pop_back();
+}
+
+/*
+ * Searches a position for the side to move. Forced moves and passes are
+ * played out first, as the player does not search a position with a single
+ * move, and the score of the first real choice is turned back into one for
+ * the side to move.
+ */
+static void analyze(Player *player, const AnalysisRequest &request,
+                    AnalysisResult &result) {
+    Board board = request.board;
+    Side side = request.side;
+    int sign = 1;
+    result.pv.clear();
+    result.nodes = 0;
+
+    while (true) {
+        if (board.isDone()) {
+            // Empty squares count for the winner, as in the endgame solver.
+            int diff = board.count(side) - board.count(opponentOf(side));
+            int empties = 64 - board.countBlack() - board.countWhite();
+            diff += (diff > 0) ? empties : (diff < 0) ? -empties : 0;
+            result.score = sign * diff;
+            result.type = SCORE_EXACT;
+            return;
+        }
+
+        MoveList moves = board.getMoves(side);
+        if (moves.size() > 1) break;
+        if (moves.empty()) {
+            result.pv.push_back(-1);
+        } else {
+            result.pv.push_back(moves[0].getSquare());
+            board.doMove(&moves[0], side);
+        }
+        side = opponentOf(side);
+        sign = -sign;
+    }
+
+    player->setSide(side);
+    player->clearSearch();
+    player->maxDepth = request.depth;
+    player->startMoveClock(request.ms);
+
+    MoveList moves = board.getMoves(side);
+    Move best = player->getMinimax(&board, moves);
+    result.nodes = player->nodes;
+
+    int score = player->lastScore;
+    int empties = 64 - board.countBlack() - board.countWhite();
+    if (player->lastSolved && empties <= player->endgameEmpties) {
+        result.type = SCORE_EXACT;
+        if (score > 0) score -= WIN_SCORE;
+        else if (score < 0) score += WIN_SCORE;
+    } else if (player->lastSolved || abs(score) >= WIN_SCORE) {
+        result.type = SCORE_WLD;
+        score = (score > 0) ? 1 : (score < 0) ? -1 : 0;
+    } else {
+        result.type = SCORE_EVAL;
+    }
+    result.score = sign * score;
+
+    result.pv.push_back(best.getSquare());
+    board.doMove(&best, side);
+    extendPV(player, board, opponentOf(side), result.pv);
+}
+
+static string squareName(int sq) {
+    if (sq < 0) return "pass";
+    return string(1, 'a' + (sq & 7)) + string(1, '1' + (sq >> 3));
+}
+
+static string formatResult(const AnalysisResult &result) {
+    char score[32];
+    const char *type;
+    if (result.type == SCORE_EVAL) {
+        snprintf(score, sizeof(score), "%+.2f",
+                 (double) result.score / EVAL_SCALE);
+        type = "eval";
+    } else {
+        snprintf(score, sizeof(score), "%+d", result.score);
+        type = (result.type == SCORE_EXACT) ? "exact" : "wld";
+    }
+
+    string move = result.pv.empty() ? "none" : squareName(result.pv[0]);
+    string line = "move " + move + " score " + score + " type " + type +
+                  " nodes " + to_string(result.nodes) + " pv";
+    for (int sq : result.pv) line += " " + squareName(sq);
+    return line;
+}
+
+/*
+ * State shared by the reader and the workers: positions waiting for a
+ * worker, and answers waiting for the ones before them to be written.
+ */
+struct AnalysisRun {
+    const AnalysisOptions &options;
+    ostream &out;
+    const Player *tables;
+
+    mutex lock;
+    condition_variable jobReady;
+    condition_variable slotFree;
+    deque<pair<long, string>> jobs;
+    map<long, string> answers;
+    long nextOutput;
+    bool inputDone;
+    int errors;
+
+    AnalysisRun(const AnalysisOptions &options, ostream &out,
+                const Player *tables)
+        : options(options), out(out), tables(tables), nextOutput(0),
+          inputDone(false), errors(0) {}
+};
+
+static void analysisWorker(AnalysisRun *run) {
+    Player player(BLACK, run->tables, run->options.hashMB, 1);
+
+    unique_lock<mutex> guard(run->lock);
+    while (true) {
+        run->jobReady.wait(guard, [run]() {
+            return !run->jobs.empty() || run->inputDone;
+        });
+        if (run->jobs.empty()) return;
+        pair<long, string> job = run->jobs.front();
+        run->jobs.pop_front();
+        guard.unlock();
+
+        AnalysisRequest request;
+        AnalysisResult result;
+        string error = parseRequest(job.second, run->options, request);
+        string answer;
+        if (error.empty()) {
+            analyze(&player, request, result);
+            answer = formatResult(result);
+        } else {
+            answer = "error " + error;
+        }
+
+        guard.lock();
+        if (!error.empty()) run->errors++;
+        run->answers[job.first] = answer;
+
+        // Write out every answer that no longer waits for an earlier one.
+        bool wrote = false;
+        map<long, string>::iterator next;
+        while ((next = run->answers.find(run->nextOutput)) !=
+               run->answers.end()) {
+            run->out << next->second << '\n';
+            run->answers.erase(next);
+            run->nextOutput++;
+            wrote = true;
+        }
+        if (wrote) {
+            run->out.flush();
+            run->slotFree.notify_all();
+        }
+    }
+}
+
+/*
+ * Analyses every position line of "in", writing one answer line per
+ * position to "out" in the same order. Returns the number of lines that
+ * could not be read.
+ */
+int runAnalysis(istream &in, ostream &out, const AnalysisOptions &options) {
+    // The workers' players share the weights, ProbCut parameters and book
+    // loaded here.
+    Player tables(BLACK, nullptr, 1, 1);
+    AnalysisRun run(options, out, &tables);
+    int workers = (options.workers < 1) ? 1 : options.workers;
+    vector<thread> pool;
+    for (int i = 0; i < workers; i++) {
+        pool.push_back(thread(analysisWorker, &run));
+    }
+
+    string line;
+    long count = 0;
+    while (getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == string::npos || line[start] == '#') continue;
+
+        unique_lock<mutex> guard(run.lock);
+        run.slotFree.wait(guard, [&]() {
+            return count - run.nextOutput < MAX_PENDING;
+        });
+        run.jobs.push_back(make_pair(count++, line));
+        run.jobReady.notify_one();
+    }
+
+    {
+        lock_guard<mutex> guard(run.lock);
+        run.inputDone = true;
+    }
+    run.jobReady.notify_all();
+    for (thread &worker : pool) {
+        worker.join();
+    }
+    return run.errors;
+}
+
+/*
+ * The player binary's "analyze" mode (argv[1]): positions on stdin, answers
+ * on stdout.
+ */
+int analysisMain(int argc, char *argv[]) {
+    AnalysisOptions options;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) options.workers = atoi(argv[++i]);
+        else if (arg == "-d" && i + 1 < argc) options.depth = atoi(argv[++i]);
+        else if (arg == "-t" && i + 1 < argc) options.ms = atol(argv[++i]);
+        else if (arg == "-h" && i + 1 < argc) options.hashMB = atoi(argv[++i]);
+        else {
+            cerr << "Usage: " << argv[0] << " analyze [-j workers] [-d depth]"
+                 << " [-t ms per position] [-h hash MB per worker]" << endl;
+            return 1;
+        }
+    }
+    if (options.depth < 1) options.depth = 1;
+    if (options.ms == 0) options.ms = -1;
+
+    // Every worker's player would announce itself on stderr.
+    Player::quiet = true;
+    return runAnalysis(cin, cout, options) ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+#ifndef __ANALYSIS_H__
+#define __ANALYSIS_H__
+
+#include <iostream>
+using namespace std;
+
+/*
+ * Settings of an analysis run. Positions are searched to "depth", or for
+ * "ms" milliseconds if that is not -1, by "workers" single-threaded players
+ * with a table of hashMB megabytes each. A line's own depth= and time=
+ * settings win over these.
+ */
+struct AnalysisOptions {
+    int workers;
+    int depth;
+    long ms;
+    int hashMB;
+
+    AnalysisOptions();
+};
+
+int runAnalysis(istream &in, ostream &out, const AnalysisOptions &options);
+int analysisMain(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,441 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "common.hpp"
+#include "board.hpp"
+#include "eval.hpp"
+#include "player.hpp"
+#include "simd.hpp"
+using namespace std;
+
+// Timed runs of each benchmark; the spread between them is the variance
+// reported.
+#define DEFAULT_RUNS 10
+
+// Slowdown (in percent) over a baseline that counts as a regression.
+#define DEFAULT_THRESHOLD 10
+
+// Depth of the searches in the "search" benchmark, and the size of their
+// hash table in megabytes, cleared before each one so every search starts
+// cold.
+#define SEARCH_DEPTH 4
+#define SEARCH_HASH_MB 1
+
+/*
+ * Games the benchmarks take their positions from, played by the engine
+ * itself after a few random moves: the moves in order, file a-h and rank 1-8
+ * (rank 1 at the top), with passes left out.
+ */
+static const char *GAMES[] = {
+    "e6f6f5d6c4d3c3e3c5f4e2c6f2e1d7c7e7d8f1g1c8b8f3d2f8b5c2b1b4a4d1c1b3a3"
+    "a6g3f7b6g5h6b2g4g6h7h4h3h5g2h8e8a8a2a1g8a7g7b7a5h1h2",
+    "e6d6c4d3c3b5c5b4b6b3c6c7a5d7e7f8a4f7c8f6e3a3a2f4e2f3f2d2d8e1f1g1d1c1"
+    "f5a7c2g5h5h6h7a6a8e8h4g6g4b1b7b2g3b8a1h2g7h3h1g2g8",
+    "e6d6c7f7c5c4c6d7f6c8d8e8f8g8e7g6c3f5g5h4b4c2b6a6h5h6b3g4d2f4b7b5c1e3"
+    "f3d3a5a4f2g3a3g1a7a8b8d1e1b2b1a2g7e2h8h7h3h2a1g2h1f1",
+    "f5d6c3f3d3g5f6f4e6g6h5h4h3g4g3e3f2e2d2e1d1c1c2b4c4f1c5b1a4b3b5h6h7c6"
+    "a3a6f7f8e7b6a5a2d7d8c7c8e8g8h8g7g2g1b2a1h2h1b8b7a7a8",
+    "e6d6c7f3e3d3c3c5c4c6d2d7d8f5b4a4b6b5a6f7f6a5a3e8f8e7e2g6h6b3c8f4g4g3"
+    "f2d1a2h5c1b1e1f1g2h1h4c2g1b2a1h2h3g5h7g7h8g8b8b7a7a8",
+    "d3e3f2c3b3d2e6f5f3f4e2f6e1c1c2b1c4a4c5b4b5g3h4g1g4g6a5a6d6g5a2b6c6h2"
+    "h5a3a7f7h7h6f1h3h1c7d1b2d8b7a8d7a1b8g7g2e8c8e7g8f8h8",
+    "f5d6c6f6d7g5e6f4f3d3e3c5g3g4h6h4b5e2c4c3f2d2e1h3d1c2b4c1b1g1b3a4a5a6"
+    "b6a3g6a7a2a1f1b2h1c7b8f7e8e7h2g2h5c8d8f8g8g7b7a8h8h7",
+    "e6d6c5f6f7b5f5f4c6g5c4b6b4c7a5a3b3d7e7e8c3e3a6b7d3a2f3g4a8a7b8c2d8g6"
+    "g3f8e2e1h3d2f1h4d1c1b1h2a4g2h6f2b2h5a1h7g1g7h1c8g8h8",
+};
+
+/*
+ * A position of the corpus with the side to move, and what the incremental
+ * evaluation keeps alongside it.
+ */
+struct Position {
+    Board board;
+    Side side;
+    BoardState state;
+};
+
+/*
+ * What the benchmarks share: the positions, the engine parts they call, and
+ * a sink that every result goes into so the compiler cannot drop the work.
+ */
+struct Corpus {
+    vector<Position> positions;
+    vector<uint64_t> P, O;
+    PatternEval eval;
+    Player *player;
+    uint64_t sink;
+};
+
+/*
+ * One benchmark: "passes" passes over the corpus make one timed run, and
+ * run() makes one pass, returning the number of operations it did.
+ */
+struct Benchmark {
+    const char *name;
+    int passes;
+    long (*run)(Corpus &corpus);
+};
+
+/*
+ * Timings of one benchmark over all runs, in nanoseconds per operation.
+ */
+struct Result {
+    string name;
+    double nsPerOp;
+    double variance;
+};
+
+/*
+ * Replays the recorded games, keeping every position with a move to play.
+ * Returns false if a game has an illegal move.
+ */
+static bool loadCorpus(Corpus &corpus) {
+    for (const char *game : GAMES) {
+        Board board;
+        Side side = BLACK;
+        for (const char *m = game; m[0] && m[1]; m += 2) {
+            if (!board.hasMoves(side)) side = opponentOf(side);
+
+            Position pos;
+            pos.board = board;
+            pos.side = side;
+            pos.state.set(board);
+            corpus.positions.push_back(pos);
+            corpus.P.push_back(board.getStones(side));
+            corpus.O.push_back(board.getStones(opponentOf(side)));
+
+            Move move(m[0] - 'a', m[1] - '1');
+            if (!board.checkMove(&move, side)) return false;
+            board.doMove(&move, side);
+            side = opponentOf(side);
+        }
+    }
+    return true;
+}
+
+static long benchGetMoves(Corpus &corpus) {
+    long ops = 0;
+    for (const Position &pos : corpus.positions) {
+        MoveList moves = pos.board.getMoves(pos.side);
+        corpus.sink += moves.size();
+        ops++;
+    }
+    return ops;
+}
+
+static long benchGetMoveMask(Corpus &corpus) {
+    long ops = 0;
+    for (const Position &pos : corpus.positions) {
+        corpus.sink ^= pos.board.getMoveMask(pos.side);
+        ops++;
+    }
+    return ops;
+}
+
+// Every square, legal or not
+static long benchCheckMove(Corpus &corpus) {
+    long ops = 0;
+    for (const Position &pos : corpus.positions) {
+        for (int sq = 0; sq < 64; sq++) {
+            Move move(sq);
+            corpus.sink += pos.board.checkMove(&move, pos.side);
+        }
+        ops += 64;
+    }
+    return ops;
+}
+
+// Every legal move, each played and taken back
+static long benchDoMove(Corpus &corpus) {
+    long ops = 0;
+    for (Position &pos : corpus.positions) {
+        MoveList moves = pos.board.getMoves(pos.side);
+        for (int i = 0; i < moves.size(); i++) {
+            uint64_t flipped = pos.board.doMove(&moves[i], pos.side);
+            pos.board.undoMove(&moves[i], flipped, pos.side);
+            corpus.sink += flipped;
+        }
+        ops += moves.size();
+    }
+    return ops;
+}
+
+static long benchCopy(Corpus &corpus) {
+    long ops = 0;
+    for (const Position &pos : corpus.positions) {
+        Board *copy = pos.board.copy();
+        corpus.sink += copy->getStones(pos.side);
+        delete copy;
+        ops++;
+    }
+    return ops;
+}
+
+// From scratch, as the book and the tools score positions
+static long benchEvaluate(Corpus &corpus) {
+    long ops = 0;
+    for (const Position &pos : corpus.positions) {
+        uint64_t P = pos.board.getStones(pos.side);
+        uint64_t O = pos.board.getStones(opponentOf(pos.side));
+        corpus.sink += corpus.eval.evaluate(P, O);
+        ops++;
+    }
+    return ops;
+}
+
+// From the pattern indices a search keeps up to date, as at its leaves
+static long benchEvaluateIncremental(Corpus &corpus) {
+    long ops = 0;
+    for (const Position &pos : corpus.positions) {
+        uint64_t P = pos.board.getStones(pos.side);
+        uint64_t O = pos.board.getStones(opponentOf(pos.side));
+        corpus.sink += corpus.eval.evaluate(pos.state.patterns, P, O,
+                                            pos.side);
+        ops++;
+    }
+    return ops;
+}
+
+// The whole corpus as one batch
+static long benchEvaluateBatch(Corpus &corpus) {
+    int n = corpus.positions.size();
+    vector<int> scores(n);
+    corpus.eval.evaluateBatch(corpus.P.data(), corpus.O.data(), scores.data(),
+                              n);
+    for (int score : scores) corpus.sink += score;
+    return n;
+}
+
+static long benchLegalMovesBatch(Corpus &corpus) {
+    int n = corpus.positions.size();
+    vector<uint64_t> moves(n);
+    legalMovesBatch(corpus.P.data(), corpus.O.data(), moves.data(), n);
+    for (uint64_t m : moves) corpus.sink ^= m;
+    return n;
+}
+
+static long benchStableDiscs(Corpus &corpus) {
+    long ops = 0;
+    for (const Position &pos : corpus.positions) {
+        corpus.sink += pos.board.getStableDiscs(pos.side);
+        ops++;
+    }
+    return ops;
+}
+
+static long benchSearch(Corpus &corpus) {
+    long ops = 0;
+    for (Position &pos : corpus.positions) {
+        corpus.player->tt.clear();
+        corpus.sink += corpus.player->getSearchScore(&pos.board, pos.side,
+                                                     SEARCH_DEPTH);
+        ops++;
+    }
+    return ops;
+}
+
+static const Benchmark BENCHMARKS[] = {
+    { "getMoves", 2000, benchGetMoves },
+    { "getMoveMask", 5000, benchGetMoveMask },
+    { "checkMove", 100, benchCheckMove },
+    { "doMove+undoMove", 200, benchDoMove },
+    { "copy", 2000, benchCopy },
+    { "evaluate", 500, benchEvaluate },
+    { "evaluateIncremental", 2000, benchEvaluateIncremental },
+    { "evaluateBatch", 2000, benchEvaluateBatch },
+    { "legalMovesBatch", 5000, benchLegalMovesBatch },
+    { "getStableDiscs", 1000, benchStableDiscs },
+    { "search", 1, benchSearch },
+};
+
+/*
+ * Times "runs" runs of a benchmark, after one untimed run to warm up.
+ */
+static Result measure(const Benchmark &bench, Corpus &corpus, int runs) {
+    bench.run(corpus);
+
+    vector<double> times;
+    for (int r = 0; r < runs; r++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        long ops = 0;
+        for (int p = 0; p < bench.passes; p++) ops += bench.run(corpus);
+        double ns = chrono::duration<double, nano>(
+            chrono::steady_clock::now() - start).count();
+        times.push_back(ns / ops);
+    }
+
+    Result result;
+    result.name = bench.name;
+    result.nsPerOp = 0;
+    for (double t : times) result.nsPerOp += t;
+    result.nsPerOp /= runs;
+    result.variance = 0;
+    for (double t : times) {
+        result.variance += (t - result.nsPerOp) * (t - result.nsPerOp);
+    }
+    result.variance /= runs;
+    return result;
+}
+
+/*
+ * Writes the results as JSON, one benchmark per line, in the form
+ * readBaseline() reads.
+ */
+static bool writeResults(const char *path, const vector<Result> &results) {
+    ofstream out(path);
+    if (!out) return false;
+    out << "{\"benchmarks\":[" << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        char line[256];
+        snprintf(line, sizeof(line),
+            "{\"name\":\"%s\",\"nsPerOp\":%.3f,\"opsPerSec\":%.0f,"
+            "\"variance\":%.6f}%s",
+            r.name.c_str(), r.nsPerOp, 1e9 / r.nsPerOp, r.variance,
+            (i + 1 < results.size()) ? "," : "");
+        out << line << endl;
+    }
+    out << "]}" << endl;
+    return (bool) out;
+}
+
+/*
+ * Reads the ns/op of each benchmark from a file written by writeResults().
+ */
+static bool readBaseline(const char *path, vector<Result> &baseline) {
+    ifstream in(path);
+    if (!in) return false;
+    string line;
+    while (getline(in, line)) {
+        size_t name = line.find("\"name\":\"");
+        size_t ns = line.find("\"nsPerOp\":");
+        if (name == string::npos || ns == string::npos) continue;
+        name += strlen("\"name\":\"");
+        Result r;
+        r.name = line.substr(name, line.find('"', name) - name);
+        r.nsPerOp = atof(line.c_str() + ns + strlen("\"nsPerOp\":"));
+        r.variance = 0;
+        baseline.push_back(r);
+    }
+    return !baseline.empty();
+}
+
+/*
+ * Times the board, evaluation and search primitives over every position of
+ * a fixed corpus of recorded games, each for a fixed number of passes per
+ * run, and prints ns/op, ops/sec and the standard deviation between runs.
+ * Results can be saved as JSON and compared against a saved baseline; any
+ * benchmark slower than the baseline by more than the threshold fails the
+ * run.
+ *
+ * The batch kernels use the best SIMD level the CPU has unless "-s" asks
+ * for a lower one.
+ *
+ * Usage: bench [-r runs] [-o results.json] [-b baseline.json]
+ *              [-t threshold percent] [-s scalar|sse2|avx2] [benchmark ...]
+ */
+int main(int argc, char *argv[]) {
+    int runs = DEFAULT_RUNS;
+    double threshold = DEFAULT_THRESHOLD;
+    const char *outPath = nullptr;
+    const char *baselinePath = nullptr;
+    vector<string> only;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) runs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            baselinePath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            const char *name = argv[++i];
+            for (int level = SIMD_SCALAR; level <= SIMD_AVX2; level++) {
+                if (!strcmp(name, simdName((SimdLevel) level))) {
+                    setSimdLevel((SimdLevel) level);
+                }
+            }
+        }
+        else if (argv[i][0] == '-') {
+            cerr << "Usage: " << argv[0] << " [-r runs] [-o results.json]"
+                 << " [-b baseline.json] [-t threshold percent]"
+                 << " [-s scalar|sse2|avx2] [benchmark ...]" << endl;
+            return 1;
+        }
+        else only.push_back(argv[i]);
+    }
+    if (runs < 1) runs = 1;
+
+    vector<Result> baseline;
+    if (baselinePath && !readBaseline(baselinePath, baseline)) {
+        cerr << "Could not read a baseline from " << baselinePath << endl;
+        return 1;
+    }
+
+    Corpus corpus;
+    if (!loadCorpus(corpus)) {
+        cerr << "Illegal move in the recorded games" << endl;
+        return 1;
+    }
+    corpus.sink = 0;
+    corpus.player = new Player(BLACK, nullptr, SEARCH_HASH_MB, 1);
+    corpus.player->startClock(&corpus.positions[0].board, -1);
+    cout << corpus.positions.size() << " positions from "
+         << sizeof(GAMES) / sizeof(GAMES[0]) << " games, " << runs
+         << " runs each, " << simdName(getSimdLevel()) << " kernels" << endl;
+
+    vector<Result> results;
+    int regressions = 0;
+    for (const Benchmark &bench : BENCHMARKS) {
+        if (!only.empty()) {
+            bool wanted = false;
+            for (const string &name : only) wanted |= (name == bench.name);
+            if (!wanted) continue;
+        }
+
+        Result r = measure(bench, corpus, runs);
+        results.push_back(r);
+        double stddev = sqrt(r.variance);
+        cout << left << setw(20) << r.name << right << fixed
+             << setprecision(2) << setw(12) << r.nsPerOp << " ns/op"
+             << setprecision(0) << setw(14) << 1e9 / r.nsPerOp << " ops/s"
+             << setprecision(2) << "  +/- " << stddev << " ns ("
+             << setprecision(1) << 100 * stddev / r.nsPerOp << "%)";
+
+        for (const Result &base : baseline) {
+            if (base.name != r.name) continue;
+            double change = 100 * (r.nsPerOp / base.nsPerOp - 1);
+            cout << showpos << "  " << change << "%" << noshowpos;
+            if (change > threshold) {
+                cout << " REGRESSION";
+                regressions++;
+            }
+        }
+        cout << endl;
+    }
+
+    // Keeps the sink, and with it all the work, alive
+    if (corpus.sink == 42) cerr << endl;
+    delete corpus.player;
+
+    if (outPath && !writeResults(outPath, results)) {
+        cerr << "Could not write " << outPath << endl;
+        return 1;
+    }
+    if (regressions) {
+        cout << regressions << " benchmarks slower than the baseline by more"
+             << " than " << threshold << "%" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+#ifndef __BITBOARD_H__
+#define __BITBOARD_H__
+
+#include <cstdint>
+
+/*
+ * Bitboard kernels shared by the board and the searches. A bitboard has bit
+ * x + 8*y set for each square (x, y) it contains; P is always the stones of
+ * the side to move and O those of its opponent.
+ */
+
+// Mask that keeps horizontal and diagonal shifts from wrapping around the
+// edge of the board.
+static constexpr uint64_t INNER_FILES = 0x7e7e7e7e7e7e7e7eULL;
+
+/*
+ * Moves for a single direction, found by flood-filling from the player's
+ * stones through a contiguous run of opponent stones (dumb7fill). A left
+ * shift of "dir" steps towards higher square indices.
+ */
+static inline uint64_t movesLeft(uint64_t P, uint64_t mask, int dir) {
+    uint64_t f = mask & (P << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    return f << dir;
+}
+
+static inline uint64_t movesRight(uint64_t P, uint64_t mask, int dir) {
+    uint64_t f = mask & (P >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    return f >> dir;
+}
+
+/*
+ * Stones flipped in a single direction when the player owning P plays at sq:
+ * the run of opponent stones starting next to sq, kept only if a player stone
+ * closes it off.
+ */
+static inline uint64_t flipsLeft(uint64_t P, uint64_t mask, uint64_t sq,
+                                 int dir) {
+    uint64_t f = mask & (sq << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    f |= mask & (f << dir);
+    return ((f << dir) & P) ? f : 0;
+}
+
+static inline uint64_t flipsRight(uint64_t P, uint64_t mask, uint64_t sq,
+                                  int dir) {
+    uint64_t f = mask & (sq >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    f |= mask & (f >> dir);
+    return ((f >> dir) & P) ? f : 0;
+}
+
+/*
+ * Returns the mask of opponent stones flipped when the player owning P plays
+ * on the (empty) square sq against the opponent stones O.
+ */
+static inline uint64_t flips(uint64_t P, uint64_t O, uint64_t sq) {
+    uint64_t inner = O & INNER_FILES;
+    return flipsLeft(P, inner, sq, 1) | flipsRight(P, inner, sq, 1)
+         | flipsLeft(P, O, sq, 8)     | flipsRight(P, O, sq, 8)
+         | flipsLeft(P, inner, sq, 7) | flipsRight(P, inner, sq, 7)
+         | flipsLeft(P, inner, sq, 9) | flipsRight(P, inner, sq, 9);
+}
+
+/*
+ * Returns the mask of all legal moves for the player owning stones P against
+ * the opponent stones O, computing all eight directions with shifts.
+ */
+static inline uint64_t legalMoves(uint64_t P, uint64_t O) {
+    uint64_t inner = O & INNER_FILES;
+    uint64_t moves = movesLeft(P, inner, 1) | movesRight(P, inner, 1)
+                   | movesLeft(P, O, 8)     | movesRight(P, O, 8)
+                   | movesLeft(P, inner, 7) | movesRight(P, inner, 7)
+                   | movesLeft(P, inner, 9) | movesRight(P, inner, 9);
+    return moves & ~(P | O);
+}
+
+// Board edges, for the stability bound
+static constexpr uint64_t FILE_A = 0x0101010101010101ULL;
+static constexpr uint64_t FILE_H = 0x8080808080808080ULL;
+static constexpr uint64_t RANKS_1_8 = 0xff000000000000ffULL;
+static constexpr uint64_t EDGES = 0xff818181818181ffULL;
+
+// The 15 diagonals running from upper left to lower right (x - y constant)
+// and the 15 running from upper right to lower left (x + y constant).
+static constexpr uint64_t DIAGONALS_9[15] = {
+    0x0000000000000080ULL, 0x0000000000008040ULL, 0x0000000000804020ULL,
+    0x0000000080402010ULL, 0x0000008040201008ULL, 0x0000804020100804ULL,
+    0x0080402010080402ULL, 0x8040201008040201ULL, 0x4020100804020100ULL,
+    0x2010080402010000ULL, 0x1008040201000000ULL, 0x0804020100000000ULL,
+    0x0402010000000000ULL, 0x0201000000000000ULL, 0x0100000000000000ULL
+};
+static constexpr uint64_t DIAGONALS_7[15] = {
+    0x0000000000000001ULL, 0x0000000000000102ULL, 0x0000000000010204ULL,
+    0x0000000001020408ULL, 0x0000000102040810ULL, 0x0000010204081020ULL,
+    0x0001020408102040ULL, 0x0102040810204080ULL, 0x0204081020408000ULL,
+    0x0408102040800000ULL, 0x0810204080000000ULL, 0x1020408000000000ULL,
+    0x2040800000000000ULL, 0x4080000000000000ULL, 0x8000000000000000ULL
+};
+
+/*
+ * Empty squares next to the opponent's stones O. Only these can ever become
+ * moves for P, so their number (potential mobility) looks further ahead than
+ * the moves P has now.
+ */
+static inline uint64_t frontier(uint64_t P, uint64_t O) {
+    uint64_t east = O & ~FILE_H, west = O & ~FILE_A;
+    uint64_t around = (O << 8) | (O >> 8)
+                    | (east << 1) | (west >> 1)
+                    | (east << 9) | (west >> 9)
+                    | (west << 7) | (east >> 7);
+    return around & ~(P | O);
+}
+
+static inline int potentialMobility(uint64_t P, uint64_t O) {
+    return __builtin_popcountll(frontier(P, O));
+}
+
+static inline int mobility(uint64_t P, uint64_t O) {
+    return __builtin_popcountll(legalMoves(P, O));
+}
+
+/*
+ * Lower bound on the stable stones of P, the stones that can never be
+ * flipped. A stone is safe along a line if the line is full, if it is on
+ * the edge the line runs into, or if a stable stone of P is next to it on
+ * that line; it is stable if it is safe along all four lines through it.
+ * Starting from the stones that are safe without any neighbours, stability
+ * spreads to their neighbours until nothing changes.
+ */
+static inline uint64_t stableDiscs(uint64_t P, uint64_t O) {
+    uint64_t occupied = P | O;
+
+    // Squares on a full row, column or diagonal
+    uint64_t r = occupied;
+    r &= r >> 1;
+    r &= r >> 2;
+    r &= r >> 4;
+    uint64_t rows = (r & FILE_A) * 0xff;
+
+    uint64_t c = occupied & (occupied >> 32);
+    c &= c >> 16;
+    c &= c >> 8;
+    uint64_t files = (c & 0xff) * FILE_A;
+
+    uint64_t diag9 = 0, diag7 = 0;
+    for (int i = 0; i < 15; i++) {
+        uint64_t d = DIAGONALS_9[i];
+        if ((occupied & d) == d) diag9 |= d;
+        d = DIAGONALS_7[i];
+        if ((occupied & d) == d) diag7 |= d;
+    }
+
+    uint64_t safeRows = rows | FILE_A | FILE_H;
+    uint64_t safeFiles = files | RANKS_1_8;
+    uint64_t safe9 = diag9 | EDGES;
+    uint64_t safe7 = diag7 | EDGES;
+
+    uint64_t stable = P & safeRows & safeFiles & safe9 & safe7;
+    uint64_t old = 0;
+    while (stable != old) {
+        old = stable;
+        uint64_t h = ((stable << 1) & ~FILE_A) | ((stable >> 1) & ~FILE_H);
+        uint64_t v = (stable << 8) | (stable >> 8);
+        uint64_t d9 = ((stable << 9) & ~FILE_A) | ((stable >> 9) & ~FILE_H);
+        uint64_t d7 = ((stable << 7) & ~FILE_H) | ((stable >> 7) & ~FILE_A);
+        stable |= P & (h | safeRows) & (v | safeFiles) & (d9 | safe9)
+                    & (d7 | safe7);
+    }
+    return stable;
+}
+
+/*
+ * Board symmetries: flipVertical maps (x, y) to (x, 7 - y), mirrorHorizontal
+ * maps it to (7 - x, y) and flipDiagonal to (y, x). Together they give all 8.
+ */
+static inline uint64_t flipVertical(uint64_t b) {
+    return __builtin_bswap64(b);
+}
+
+static inline uint64_t mirrorHorizontal(uint64_t b) {
+    b = ((b >> 1) & 0x5555555555555555ULL) | ((b & 0x5555555555555555ULL) << 1);
+    b = ((b >> 2) & 0x3333333333333333ULL) | ((b & 0x3333333333333333ULL) << 2);
+    b = ((b >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((b & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return b;
+}
+
+static inline uint64_t flipDiagonal(uint64_t b) {
+    uint64_t t;
+    t = 0x0f0f0f0f00000000ULL & (b ^ (b << 28));
+    b ^= t ^ (t >> 28);
+    t = 0x3333000033330000ULL & (b ^ (b << 14));
+    b ^= t ^ (t >> 14);
+    t = 0x5500550055005500ULL & (b ^ (b << 7));
+    b ^= t ^ (t >> 7);
+    return b;
+}
+
+/*
+ * Image of a bitboard under symmetry s (0 to 7): bit 0 mirrors x, bit 1
+ * flips y and bit 2 then swaps x and y.
+ */
+static inline uint64_t transformBoard(uint64_t b, int s) {
+    if (s & 1) b = mirrorHorizontal(b);
+    if (s & 2) b = flipVertical(b);
+    if (s & 4) b = flipDiagonal(b);
+    return b;
+}
+
+#endif
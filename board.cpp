@@ -1,292 +1,334 @@
 #include "board.hpp"
+#include "bitboard.hpp"
+
+/*
+ * Random keys for Zobrist hashing: one per square for each colour, plus one
+ * that is mixed in when black is to move. They come from a fixed-seed
+ * generator so hashes are the same from run to run.
+ */
+struct ZobristKeys {
+    uint64_t disc[2][64];
+    uint64_t flip[64];
+    uint64_t blackToMove;
+
+    ZobristKeys() {
+        uint64_t seed = 0x9e3779b97f4a7c15ULL;
+        for (int i = 0; i < 64; i++) {
+            disc[WHITE][i] = next(seed);
+            disc[BLACK][i] = next(seed);
+            flip[i] = disc[WHITE][i] ^ disc[BLACK][i];
+        }
+        blackToMove = next(seed);
+    }
+
+    // splitmix64
+    static uint64_t next(uint64_t &state) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+};
+
+static const ZobristKeys ZOBRIST;
+
+constexpr uint64_t Board::CORNERS;
+constexpr uint64_t Board::NEXT_TO_CORNERS;
 
 /*
  * Make a standard 8x8 othello board and initialize it to the standard setup.
  */
 Board::Board() {
-    taken.set(3 + 8 * 3);
-    taken.set(3 + 8 * 4);
-    taken.set(4 + 8 * 3);
-    taken.set(4 + 8 * 4);
-    black.set(4 + 8 * 3);
-    black.set(3 + 8 * 4);
-
-    /*
-    multiplier = {120, -20,  20,   5,   5,  20, -20, 120,
-                  -20, -40,  -5,  -5,  -5,  -5, -40, -20,
-                   20,  -5,  15,   3,   3,  15,  -5,  20,
-                    5,  -5,   3,   3,   3,   3,  -5,   5, 
-                    5,  -5,   3,   3,   3,   3,  -5,   5,
-                   20,  -5,  15,   3,   3,  15,  -5,  20,
-                  -20, -40,  -5,  -5,  -5,  -5, -40, -20,
-                  120, -20,  20,   5,   5,  20, -20, 120};
-    */
-    multiplier = {1000,   50,  100,  100,  100,  100,   50, 1000,
-                    50,  -20,  -10,  -10,  -10,  -10,  -20,   50, 
-                   100,  -10,    1,    1,    1,    1,  -10,  100,
-                   100,  -10,    1,    1,    1,    1,  -10,  100,
-                   100,  -10,    1,    1,    1,    1,  -10,  100,
-                   100,  -10,    1,    1,    1,    1,  -10,  100,
-                    50,  -20,  -10,  -10,  -10,  -10,  -20,   50,
-                  1000,   50,  100,  100,  100,  100,   50, 1000};
+    black = (1ULL << (4 + 8 * 3)) | (1ULL << (3 + 8 * 4));
+    white = (1ULL << (3 + 8 * 3)) | (1ULL << (4 + 8 * 4));
 }
 
 /*
- * Destructor for the board.
+ * Returns a copy of this board.
  */
-Board::~Board() {
+Board *Board::copy() const {
+    return new Board(*this);
+}
+
+bool Board::occupied(int x, int y) const {
+    return ((black | white) >> (x + 8*y)) & 1;
 }
 
 /*
- * Returns a copy of this board.
+ * Computes the Zobrist hash of the position with the given side to move from
+ * scratch. Searches keep it up to date in a BoardState instead.
  */
-Board *Board::copy() {
-    Board *newBoard = new Board();
-    newBoard->black = black;
-    newBoard->taken = taken;
-    return newBoard;
+uint64_t Board::getHash(Side toMove) const {
+    BoardState state;
+    state.set(*this);
+    return state.getHash(toMove);
 }
 
-bool Board::occupied(int x, int y) {
-    return taken[x + 8*y];
+/*
+ * Toggles the hash keys of a placed stone and the stones it flipped.
+ */
+static inline uint64_t hashDelta(uint64_t flipped, int sq, Side side) {
+    uint64_t delta = ZOBRIST.disc[side][sq];
+    while (flipped) {
+        delta ^= ZOBRIST.flip[__builtin_ctzll(flipped)];
+        flipped &= flipped - 1;
+    }
+    return delta;
 }
 
-bool Board::get(Side side, int x, int y) {
-    return occupied(x, y) && (black[x + 8*y] == (side == BLACK));
+/*
+ * Computes the hash and the pattern indices of a board from scratch.
+ */
+void BoardState::set(const Board &board) {
+    uint64_t black = board.getStones(BLACK);
+    uint64_t white = board.getStones(WHITE);
+
+    hash = 0;
+    for (int i = 0; i < PATTERN_INSTANCES; i++) {
+        patterns[i] = 0;
+    }
+    for (int sq = 0; sq < 64; sq++) {
+        Side side;
+        if ((black >> sq) & 1) side = BLACK;
+        else if ((white >> sq) & 1) side = WHITE;
+        else continue;
+
+        hash ^= ZOBRIST.disc[side][sq];
+        int digit = (side == BLACK) ? 1 : 2;
+        const SquarePatterns &sp = PatternEval::squarePatterns[sq];
+        for (int j = 0; j < sp.count; j++) {
+            patterns[sp.instance[j]] += digit * sp.power[j];
+        }
+    }
 }
 
-void Board::set(Side side, int x, int y) {
-    taken.set(x + 8*y);
-    black.set(x + 8*y, side == BLACK);
+/*
+ * Returns the Zobrist hash of the position with the given side to move.
+ */
+template <Side toMove> uint64_t BoardState::getHash() const {
+    return (toMove == BLACK) ? hash ^ ZOBRIST.blackToMove : hash;
 }
 
-bool Board::onBoard(int x, int y) {
-    return(0 <= x && x < 8 && 0 <= y && y < 8);
+uint64_t BoardState::getHash(Side toMove) const {
+    return (toMove == BLACK) ? getHash<BLACK>() : getHash<WHITE>();
 }
 
+/*
+ * Follows a move made on the board: the side's disc placed on sq and the
+ * discs in "flipped" (as Board::doMove() returned them) turned over.
+ */
+template <Side side> void BoardState::doMove(uint64_t flipped, int sq) {
+    if (flipped == 0) return;
+    hash ^= hashDelta(flipped, sq, side);
+    updatePatterns<side, 1>(flipped, sq);
+}
+
+void BoardState::doMove(uint64_t flipped, int sq, Side side) {
+    if (side == BLACK) doMove<BLACK>(flipped, sq);
+    else doMove<WHITE>(flipped, sq);
+}
+
+/*
+ * Follows a move taken back on the board.
+ */
+template <Side side> void BoardState::undoMove(uint64_t flipped, int sq) {
+    if (flipped == 0) return;
+    hash ^= hashDelta(flipped, sq, side);
+    updatePatterns<side, -1>(flipped, sq);
+}
+
+void BoardState::undoMove(uint64_t flipped, int sq, Side side) {
+    if (side == BLACK) undoMove<BLACK>(flipped, sq);
+    else undoMove<WHITE>(flipped, sq);
+}
+
+/*
+ * Adds (sign 1) or takes back (sign -1) a move's change to the pattern
+ * indices: the placed disc's digit goes from 0 to 1 or 2, and every flipped
+ * disc's digit from 2 to 1 (black moving) or from 1 to 2 (white moving).
+ */
+template <Side side, int sign>
+void BoardState::updatePatterns(uint64_t flipped, int sq) {
+    const int placed = sign * ((side == BLACK) ? 1 : 2);
+    const SquarePatterns &sp = PatternEval::squarePatterns[sq];
+    for (int j = 0; j < sp.count; j++) {
+        patterns[sp.instance[j]] += placed * sp.power[j];
+    }
+
+    const int flip = sign * ((side == BLACK) ? -1 : 1);
+    while (flipped) {
+        const SquarePatterns &fp =
+            PatternEval::squarePatterns[__builtin_ctzll(flipped)];
+        for (int j = 0; j < fp.count; j++) {
+            patterns[fp.instance[j]] += flip * fp.power[j];
+        }
+        flipped &= flipped - 1;
+    }
+}
+
+template void BoardState::doMove<BLACK>(uint64_t, int);
+template void BoardState::doMove<WHITE>(uint64_t, int);
+template void BoardState::undoMove<BLACK>(uint64_t, int);
+template void BoardState::undoMove<WHITE>(uint64_t, int);
+template uint64_t BoardState::getHash<BLACK>() const;
+template uint64_t BoardState::getHash<WHITE>() const;
 
 /*
  * Returns true if the game is finished; false otherwise. The game is finished
  * if neither side has a legal move.
  */
-bool Board::isDone() {
-    return !(hasMoves(BLACK) || hasMoves(WHITE));
+bool Board::isDone() const {
+    return (getMoveMask(BLACK) | getMoveMask(WHITE)) == 0;
 }
 
 /*
  * Returns true if a move is legal for the given side; false otherwise.
  */
-bool Board::checkMove(Move *m, Side side) {
+bool Board::checkMove(Move *m, Side side) const {
     // Passing is only legal if you have no moves.
     if (m == nullptr) return !hasMoves(side);
 
-    int X = m->getX();
-    int Y = m->getY();
-
-    // Make sure the square hasn't already been taken.
-    if (occupied(X, Y)) return false;
-
-    Side other = (side == BLACK) ? WHITE : BLACK;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            // Is there a capture in that direction?
-            int x = X + dx;
-            int y = Y + dy;
-            if (onBoard(x, y) && get(other, x, y)) {
-                do {
-                    x += dx;
-                    y += dy;
-                } while (onBoard(x, y) && get(other, x, y));
-
-                if (onBoard(x, y) && get(side, x, y)) return true;
-            }
-        }
-    }
-    return false;
+    return (getMoveMask(side) >> (m->getX() + 8 * m->getY())) & 1;
 }
 
 /*
  * Returns true if there are legal moves for the given side.
  */
-bool Board::hasMoves(Side side) {
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            Move move(i, j);
-            if (checkMove(&move, side)) return true;
-        }
-    }
-    return false;
+bool Board::hasMoves(Side side) const {
+    return getMoveMask(side) != 0;
+}
+
+/*
+ * Returns a mask with one bit set (at x + 8*y) for every legal move of the
+ * given side.
+ */
+uint64_t Board::getMoveMask(Side side) const {
+    return (side == BLACK) ? getMoveMask<BLACK>() : getMoveMask<WHITE>();
+}
+
+/*
+ * Returns a mask with one bit set (at x + 8*y) for every stone of the given
+ * side.
+ */
+uint64_t Board::getStones(Side side) const {
+    return (side == BLACK) ? black : white;
 }
 
 /*
- * Returns vector of all possible moves for the given side.
+ * Returns the list of all possible moves for the given side.
  */
-vector<Move*> Board::getMoves(Side side)
+MoveList Board::getMoves(Side side) const
 {
-    vector<Move*> to_return;
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            Move *move = new Move(i, j);
-            if (checkMove(move, side)) 
-            {
-                to_return.push_back(move);
-            }
-        }
-    }
-    return to_return;
+    return MoveList(getMoveMask(side));
 }
 
 /*
- * Modifies the board to reflect the specified move.
+ * Modifies the board to reflect the specified move. Returns the mask of
+ * stones that were flipped, which undoMove() needs to take the move back; an
+ * empty mask means the move was a pass or was ignored as invalid.
  */
-void Board::doMove(Move *m, Side side) {
+uint64_t Board::doMove(Move *m, Side side) {
     // A nullptr move means pass.
-    if (m == nullptr) return;
-
-    // Ignore if move is invalid.
-    if (!checkMove(m, side)) return;
+    if (m == nullptr) return 0;
 
     int X = m->getX();
     int Y = m->getY();
-    Side other = (side == BLACK) ? WHITE : BLACK;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            int x = X;
-            int y = Y;
-            do {
-                x += dx;
-                y += dy;
-            } while (onBoard(x, y) && get(other, x, y));
-
-            if (onBoard(x, y) && get(side, x, y)) {
-                x = X;
-                y = Y;
-                x += dx;
-                y += dy;
-                while (onBoard(x, y) && get(other, x, y)) {
-                    set(side, x, y);
-                    x += dx;
-                    y += dy;
-                }
-            }
-        }
-    }
-    set(side, X, Y);
+
+    // Ignore if move is invalid.
+    if (occupied(X, Y)) return 0;
+
+    // Or if it flips nothing.
+    int sq = X + 8 * Y;
+    uint64_t P = getStones(side);
+    uint64_t O = getStones(opponentOf(side));
+    if (flips(P, O, 1ULL << sq) == 0) return 0;
+
+    return (side == BLACK) ? doMove<BLACK>(sq) : doMove<WHITE>(sq);
+}
+
+/*
+ * Takes back a move made by doMove(), given the mask of flipped stones that
+ * doMove() returned for it.
+ */
+void Board::undoMove(Move *m, uint64_t flipped, Side side) {
+    if (m == nullptr || flipped == 0) return;
+
+    if (side == BLACK) undoMove<BLACK>(m->getSquare(), flipped);
+    else undoMove<WHITE>(m->getSquare(), flipped);
 }
 
 /*
  * Current count of given side's stones.
  */
-int Board::count(Side side) {
+int Board::count(Side side) const {
     return (side == BLACK) ? countBlack() : countWhite();
 }
 
 /*
  * Current count of black stones.
  */
-int Board::countBlack() {
-    return black.count();
+int Board::countBlack() const {
+    return __builtin_popcountll(black);
 }
 
 /*
  * Current count of white stones.
  */
-int Board::countWhite() {
-    return taken.count() - black.count();
+int Board::countWhite() const {
+    return __builtin_popcountll(white);
 }
 
 /*
- * Determines if a move is in the corner
+ * Number of legal moves of the given side.
  */
-bool Board::isCorner(Move * m)
-{
-    return (m->getX() == 0 && m->getY() == 0) ||
-            (m->getX() == 0 && m->getY() == 7) ||
-            (m->getX() == 7 && m->getY() == 0) ||
-            (m->getX() == 7 && m->getY() == 7);
+int Board::getMobility(Side side) const {
+    return mobility(getStones(side), getStones(opponentOf(side)));
 }
 
 /*
- * Determines if a move is next to the corner
+ * Number of empty squares next to the other side's stones, where the given
+ * side may get moves later.
  */
-bool Board::isNextToCorner(Move *m)
-{
-    return (m->getX() == 1 && m->getY() == 0) ||
-            (m->getX() == 0 && m->getY() == 1) ||
-            (m->getX() == 1 && m->getY() == 1) ||
-            (m->getX() == 6 && m->getY() == 0) ||
-            (m->getX() == 6 && m->getY() == 1) ||
-            (m->getX() == 7 && m->getY() == 1) ||
-            (m->getX() == 0 && m->getY() == 6) ||
-            (m->getX() == 1 && m->getY() == 6) ||
-            (m->getX() == 1 && m->getY() == 7) ||
-            (m->getX() == 6 && m->getY() == 6) ||
-            (m->getX() == 7 && m->getY() == 6) ||
-            (m->getX() == 6 && m->getY() == 7);
+int Board::getPotentialMobility(Side side) const {
+    return potentialMobility(getStones(side), getStones(opponentOf(side)));
 }
 
-/**
- * Gets weighted score based on square values
+/*
+ * Stones of the given side that can never be flipped again (a lower bound:
+ * some stable stones may be missing).
  */
-int Board::getWeightedScore(Side side)
+uint64_t Board::getStableDiscs(Side side) const {
+    return stableDiscs(getStones(side), getStones(opponentOf(side)));
+}
+
+/*
+ * Determines if a move is in the corner
+ */
+bool Board::isCorner(Move * m) const
 {
-    int score = 0;
-
-    if (side == BLACK)
-    {
-        for (int i = 0; i < 64; i++)
-        {
-            if (taken[i])
-            {
-                if (black[i])
-                {
-                    score = score + multiplier[i];
-                }
-                else
-                {
-                    score = score - multiplier[i];
-                }
-            }
-        }
-    }
-    else
-    {
-        for (int i = 0; i < 64; i++)
-        {
-            if (taken[i])
-            {
-                if (black[i])
-                {
-                    score = score - multiplier[i];
-                }
-                else
-                {
-                    score = score + multiplier[i];
-                }
-            }
-        }
-    }
+    return (CORNERS >> m->getSquare()) & 1;
+}
 
-    return score;
+/*
+ * Determines if a move is next to the corner
+ */
+bool Board::isNextToCorner(Move *m) const
+{
+    return (NEXT_TO_CORNERS >> m->getSquare()) & 1;
 }
 
 /*
  * Sets the board state given an 8x8 char array where 'w' indicates a white
  * piece and 'b' indicates a black piece. Mainly for testing purposes.
  */
-void Board::setBoard(char data[]) {
-    taken.reset();
-    black.reset();
+void Board::setBoard(const char data[]) {
+    black = 0;
+    white = 0;
     for (int i = 0; i < 64; i++) {
         if (data[i] == 'b') {
-            taken.set(i);
-            black.set(i);
+            black |= 1ULL << i;
         } if (data[i] == 'w') {
-            taken.set(i);
+            white |= 1ULL << i;
         }
     }
 }
@@ -1,44 +1,114 @@
 #ifndef __BOARD_H__
 #define __BOARD_H__
 
-#include <bitset>
-#include <vector>
+#include <cstdint>
 #include <iostream>
+#include <type_traits>
 #include "common.hpp"
+#include "eval.hpp"
+#include "bitboard.hpp"
 using namespace std;
 
+/*
+ * An othello position: one bitboard (bit x + 8*y) per colour. Boards are
+ * plain 16-byte values, cheap to copy and to keep in arrays; whatever a
+ * search keeps up to date alongside them lives in a BoardState.
+ *
+ * The kernels the search runs at every node also come templated on the side
+ * to move, which picks the player's and the opponent's bitboards at compile
+ * time; the versions taking a Side pick one of those at run time.
+ */
 class Board {
 
 private:
-    bitset<64> black;
-    bitset<64> taken;
-    vector<int> multiplier;
+    uint64_t black;
+    uint64_t white;
 
-    bool occupied(int x, int y);
-    bool get(Side side, int x, int y);
-    void set(Side side, int x, int y);
-    bool onBoard(int x, int y);
+    bool occupied(int x, int y) const;
 
 public:
     Board();
-    ~Board();
-    Board *copy();
+    Board *copy() const;
 
-    bool isDone();
-    bool hasMoves(Side side);
-    bool checkMove(Move *m, Side side);
-    void doMove(Move *m, Side side);
-    int count(Side side);
-    int countBlack();
-    int countWhite();
-    bool isCorner(Move *m);
-    bool isNextToCorner(Move *m);
+    bool isDone() const;
+    bool hasMoves(Side side) const;
+    uint64_t getMoveMask(Side side) const;
+    uint64_t getStones(Side side) const;
+    bool checkMove(Move *m, Side side) const;
+    uint64_t doMove(Move *m, Side side);
+    void undoMove(Move *m, uint64_t flipped, Side side);
+    int count(Side side) const;
+    int countBlack() const;
+    int countWhite() const;
+    bool isCorner(Move *m) const;
+    bool isNextToCorner(Move *m) const;
 
-    int getWeightedScore(Side side);
+    int getMobility(Side side) const;
+    int getPotentialMobility(Side side) const;
+    uint64_t getStableDiscs(Side side) const;
 
-    void setBoard(char data[]);
+    uint64_t getHash(Side toMove) const;
 
-    vector<Move*> getMoves(Side side);
+    void setBoard(const char data[]);
+
+    MoveList getMoves(Side side) const;
+
+    template <Side side> uint64_t getStones() const {
+        return (side == BLACK) ? black : white;
+    }
+
+    template <Side side> uint64_t getMoveMask() const {
+        return legalMoves(getStones<side>(), getStones<opponentOf(side)>());
+    }
+
+    /*
+     * Plays a legal move on square sq and returns the flipped stones.
+     */
+    template <Side side> uint64_t doMove(int sq) {
+        uint64_t &P = (side == BLACK) ? black : white;
+        uint64_t &O = (side == BLACK) ? white : black;
+        uint64_t bit = 1ULL << sq;
+        uint64_t flipped = flips(P, O, bit);
+        P |= flipped | bit;
+        O ^= flipped;
+        return flipped;
+    }
+
+    template <Side side> void undoMove(int sq, uint64_t flipped) {
+        uint64_t &P = (side == BLACK) ? black : white;
+        uint64_t &O = (side == BLACK) ? white : black;
+        P ^= flipped | (1ULL << sq);
+        O ^= flipped;
+    }
+
+    static constexpr uint64_t CORNERS = 0x8100000000000081ULL;
+    static constexpr uint64_t NEXT_TO_CORNERS = 0x42c300000000c342ULL;
+};
+
+static_assert(sizeof(Board) == 16 && is_trivially_copyable<Board>::value,
+              "Board must stay a 16-byte value");
+
+/*
+ * What a search keeps up to date alongside its board as it makes and takes
+ * back moves: the Zobrist hash of the discs and the index of every pattern
+ * placement, black discs as 1 and white as 2.
+ */
+struct BoardState {
+    uint64_t hash;
+    uint16_t patterns[PATTERN_INSTANCES];
+
+    void set(const Board &board);
+    void doMove(uint64_t flipped, int sq, Side side);
+    void undoMove(uint64_t flipped, int sq, Side side);
+    uint64_t getHash(Side toMove) const;
+
+    template <Side side> void doMove(uint64_t flipped, int sq);
+    template <Side side> void undoMove(uint64_t flipped, int sq);
+    template <Side toMove> uint64_t getHash() const;
+
+private:
+    template <Side side, int sign>
+    void updatePatterns(uint64_t flipped, int sq);
 };
 
 #endif
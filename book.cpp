@@ -0,0 +1,187 @@
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "book.hpp"
+#include "bitboard.hpp"
+
+// Book file format: a header with the magic bytes, a version and the number
+// of entries, then the entries sorted by (player, opponent).
+#define BOOK_MAGIC "OTHB"
+#define BOOK_VERSION 1
+
+struct BookHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+};
+
+static inline bool keyLess(const BookEntry &a, const BookEntry &b) {
+    return a.player < b.player ||
+           (a.player == b.player && a.opponent < b.opponent);
+}
+
+/*
+ * Make an empty book.
+ */
+OpeningBook::OpeningBook() {
+    map = nullptr;
+    mapSize = 0;
+    entries = nullptr;
+    size = 0;
+}
+
+/*
+ * Destructor for the book.
+ */
+OpeningBook::~OpeningBook() {
+    close();
+}
+
+/*
+ * Maps a book file written by write(). Returns false, leaving the book
+ * empty, if the file is missing or not a book.
+ */
+bool OpeningBook::open(const char *path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(BookHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+
+    const BookHeader *header = (const BookHeader *) data;
+    if (memcmp(header->magic, BOOK_MAGIC, 4) != 0 ||
+        header->version != BOOK_VERSION ||
+        sizeof(BookHeader) + header->count * sizeof(BookEntry) !=
+            (size_t) st.st_size) {
+        munmap(data, st.st_size);
+        return false;
+    }
+
+    map = data;
+    mapSize = st.st_size;
+    entries = (const BookEntry *) (header + 1);
+    size = header->count;
+    return true;
+}
+
+/*
+ * Unmaps the book file, if any.
+ */
+void OpeningBook::close() {
+    if (map) munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    entries = nullptr;
+    size = 0;
+}
+
+bool OpeningBook::isOpen() {
+    return map != nullptr;
+}
+
+uint64_t OpeningBook::getSize() {
+    return size;
+}
+
+const BookEntry &OpeningBook::getEntry(uint64_t i) {
+    return entries[i];
+}
+
+/*
+ * Looks up a position (P to move) in any orientation by binary search.
+ */
+bool OpeningBook::probe(uint64_t P, uint64_t O, BookEntry &entry) {
+    BookEntry key;
+    key.player = P;
+    key.opponent = O;
+    canonicalize(key.player, key.opponent);
+
+    const BookEntry *found = lower_bound(entries, entries + size, key, keyLess);
+    if (found == entries + size || found->player != key.player ||
+        found->opponent != key.opponent) {
+        return false;
+    }
+    entry = *found;
+    return true;
+}
+
+/*
+ * Returns the book move for P (the square, or -1 if the book does not know
+ * every reply), with its score in "score". The move leading to the position
+ * that is worst for the opponent wins; among equal scores, the one played
+ * most often. A position reached by transposition, or only ever stored as a
+ * reply, may have just some of its replies in the book; the best of those
+ * could still be worse than one never scored, so the search decides there.
+ */
+int OpeningBook::getMove(uint64_t P, uint64_t O, int &score) {
+    if (size == 0) return -1;
+
+    int best = -1;
+    uint32_t bestCount = 0;
+    uint64_t moves = legalMoves(P, O);
+    while (moves) {
+        int sq = __builtin_ctzll(moves);
+        moves &= moves - 1;
+        uint64_t f = flips(P, O, 1ULL << sq);
+
+        BookEntry entry;
+        if (!probe(O & ~f, P | f | (1ULL << sq), entry)) return -1;
+        if (best < 0 || -entry.score > score ||
+            (-entry.score == score && entry.count > bestCount)) {
+            best = sq;
+            score = -entry.score;
+            bestCount = entry.count;
+        }
+    }
+    return best;
+}
+
+/*
+ * Replaces a position by the image, among its 8 symmetric ones, that sorts
+ * first; every orientation of a position has the same canonical form.
+ */
+void OpeningBook::canonicalize(uint64_t &P, uint64_t &O) {
+    uint64_t bestP = P, bestO = O;
+    for (int s = 1; s < 8; s++) {
+        uint64_t p = transformBoard(P, s);
+        uint64_t o = transformBoard(O, s);
+        if (p < bestP || (p == bestP && o < bestO)) {
+            bestP = p;
+            bestO = o;
+        }
+    }
+    P = bestP;
+    O = bestO;
+}
+
+/*
+ * Writes a book file holding the given entries, which must already be in
+ * canonical form. Sorts them in place.
+ */
+bool OpeningBook::write(const char *path, vector<BookEntry> &entries) {
+    sort(entries.begin(), entries.end(), keyLess);
+
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+
+    BookHeader header;
+    memcpy(header.magic, BOOK_MAGIC, 4);
+    header.version = BOOK_VERSION;
+    header.count = entries.size();
+    out.write((const char *) &header, sizeof(header));
+    out.write((const char *) entries.data(), entries.size() * sizeof(BookEntry));
+    return (bool) out;
+}
@@ -0,0 +1,52 @@
+#ifndef __BOOK_H__
+#define __BOOK_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "common.hpp"
+using namespace std;
+
+/*
+ * One book position: the discs of the side to move and of its opponent,
+ * taken in their canonical orientation, the position's search score for the
+ * side to move, and how many times the book's games went through it.
+ */
+struct BookEntry {
+    uint64_t player;
+    uint64_t opponent;
+    int32_t score;
+    uint32_t count;
+};
+
+/*
+ * Opening book read straight from a memory-mapped file of entries sorted by
+ * position, so opening even a large book costs nothing until it is probed.
+ * Positions are stored once for all 8 board symmetries.
+ */
+class OpeningBook {
+
+private:
+    void *map;
+    size_t mapSize;
+    const BookEntry *entries;
+    uint64_t size;
+
+public:
+    OpeningBook();
+    ~OpeningBook();
+
+    bool open(const char *path);
+    void close();
+    bool isOpen();
+    uint64_t getSize();
+    const BookEntry &getEntry(uint64_t i);
+
+    bool probe(uint64_t P, uint64_t O, BookEntry &entry);
+    int getMove(uint64_t P, uint64_t O, int &score);
+
+    static void canonicalize(uint64_t &P, uint64_t &O);
+    static bool write(const char *path, vector<BookEntry> &entries);
+};
+
+#endif
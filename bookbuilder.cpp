@@ -0,0 +1,167 @@
+#include <iostream>
+#include <cstdlib>
+#include <map>
+#include <utility>
+#include "common.hpp"
+#include "board.hpp"
+#include "player.hpp"
+#include "book.hpp"
+using namespace std;
+
+// Chance (in percent) that a book game plays a random move instead of the
+// best one, so the games spread over different openings.
+#define RANDOM_MOVE_PERCENT 25
+
+typedef pair<uint64_t, uint64_t> Position;
+
+static Position canonical(Board &board, Side side) {
+    uint64_t P = board.getStones(side);
+    uint64_t O = board.getStones(opponentOf(side));
+    OpeningBook::canonicalize(P, O);
+    return Position(P, O);
+}
+
+/*
+ * Book positions being built, with a search score for each. Searches are
+ * only run for positions not seen before.
+ */
+struct BookBuilder {
+    map<Position, BookEntry> positions;
+    Player *players[2];
+    long searches;
+
+    BookBuilder(int depth) {
+        searches = 0;
+        for (int s = 0; s < 2; s++) {
+            players[s] = new Player(s ? BLACK : WHITE);
+            players[s]->maxDepth = depth;
+        }
+    }
+
+    ~BookBuilder() {
+        delete players[0];
+        delete players[1];
+    }
+
+    // The book entry of a position with the side to move, searching it if
+    // it is new. A side that must pass, or has only one move, gets the
+    // (negated) score of the position after it; the search returns at once
+    // there without scoring anything. A finished game scores its discs.
+    BookEntry *score(Board &board, Side side) {
+        Position key = canonical(board, side);
+        map<Position, BookEntry>::iterator it = positions.find(key);
+        if (it != positions.end()) return &it->second;
+
+        MoveList moves = board.getMoves(side);
+        Player *player = players[side];
+        int value;
+        if (moves.empty() && board.isDone()) {
+            value = player->getFinalScore(&board, side);
+        } else if (moves.empty()) {
+            value = -score(board, opponentOf(side))->score;
+        } else if (moves.size() == 1) {
+            Board child = board;
+            child.doMove(&moves[0], side);
+            value = -score(child, opponentOf(side))->score;
+        } else {
+            player->startClock(&board, -1);
+            player->tt.newSearch();
+            player->getMinimax(&board, moves);
+            searches++;
+            value = player->lastScore;
+        }
+
+        BookEntry entry;
+        entry.player = key.first;
+        entry.opponent = key.second;
+        entry.score = value;
+        entry.count = 0;
+        return &(positions[key] = entry);
+    }
+
+    // Plays one game out to the given number of plies, scoring every reply
+    // along the way so the book always knows the alternatives.
+    void playGame(int plies) {
+        Board board;
+        Side side = BLACK;
+        for (int ply = 0; ply < plies && !board.isDone(); ply++) {
+            MoveList moves = board.getMoves(side);
+            if (moves.empty()) {
+                side = opponentOf(side);
+                continue;
+            }
+            score(board, side)->count++;
+
+            int best = 0;
+            int bestScore = 0;
+            for (int i = 0; i < moves.size(); i++) {
+                Board child = board;
+                child.doMove(&moves[i], side);
+                int childScore = -score(child, opponentOf(side))->score;
+                if (i == 0 || childScore > bestScore) {
+                    best = i;
+                    bestScore = childScore;
+                }
+            }
+
+            if (rand() % 100 < RANDOM_MOVE_PERCENT) {
+                best = rand() % moves.size();
+            }
+            board.doMove(&moves[best], side);
+            side = opponentOf(side);
+        }
+    }
+};
+
+/*
+ * Builds (or extends) an opening book from self-play: each game follows the
+ * best move by a fixed-depth search, with some random moves mixed in, and
+ * every position it reaches and every reply is stored with its score.
+ *
+ * Usage: bookbuilder <book file> [games] [plies] [depth] [seed]
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0]
+             << " <book file> [games] [plies] [depth] [seed]" << endl;
+        return 1;
+    }
+    const char *path = argv[1];
+    int games = (argc > 2) ? atoi(argv[2]) : 100;
+    int plies = (argc > 3) ? atoi(argv[3]) : 12;
+    int depth = (argc > 4) ? atoi(argv[4]) : 8;
+    srand((argc > 5) ? atoi(argv[5]) : 1);
+
+    BookBuilder builder(depth);
+
+    // Keep what an existing book already has
+    OpeningBook old;
+    if (old.open(path)) {
+        for (uint64_t i = 0; i < old.getSize(); i++) {
+            const BookEntry &entry = old.getEntry(i);
+            builder.positions[Position(entry.player, entry.opponent)] = entry;
+        }
+        cerr << "Extending " << old.getSize() << " positions from " << path
+             << endl;
+        old.close();
+    }
+
+    for (int game = 0; game < games; game++) {
+        builder.playGame(plies);
+        cerr << "Game " << game + 1 << " of " << games << ": "
+             << builder.positions.size() << " positions, "
+             << builder.searches << " searches" << endl;
+    }
+
+    vector<BookEntry> entries;
+    for (map<Position, BookEntry>::iterator it = builder.positions.begin();
+         it != builder.positions.end(); ++it) {
+        entries.push_back(it->second);
+    }
+    if (!OpeningBook::write(path, entries)) {
+        cerr << "Could not write " << path << endl;
+        return 1;
+    }
+    cout << "Wrote " << entries.size() << " positions to " << path << endl;
+    return 0;
+}
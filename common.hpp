@@ -1,25 +1,85 @@
 #ifndef __COMMON_H__
 #define __COMMON_H__
 
-enum Side { 
+#include <cstdint>
+
+enum Side {
     WHITE, BLACK
 };
 
+/*
+ * The side playing against the given one. It is constexpr, so code templated
+ * on the side to move can name the other side at compile time too.
+ */
+constexpr Side opponentOf(Side side) {
+    return (side == BLACK) ? WHITE : BLACK;
+}
+
+/*
+ * A move is stored as the index x + 8*y of the square it is played on; the
+ * x/y accessors are only needed at the protocol boundary.
+ */
 class Move {
-   
+
+public:
+    uint8_t sq;
+    Move() : sq(0) {}
+    Move(int x, int y) : sq(x + 8 * y) {}
+    explicit Move(int sq) : sq(sq) {}
+
+    int getX() const { return sq & 7; }
+    int getY() const { return sq >> 3; }
+    int getSquare() const { return sq; }
+
+    void setX(int x) { sq = (sq & ~7) | x; }
+    void setY(int y) { sq = (sq & 7) | (y << 3); }
+};
+
+/*
+ * Fixed-capacity list of moves that lives on the stack, so generating moves
+ * during search never touches the heap. No position has more legal moves
+ * than there are empty squares.
+ */
+class MoveList {
+
 public:
-    int x, y;
-    Move(int x, int y) {
-        this->x = x;
-        this->y = y;        
+    static const int CAPACITY = 60;
+
+    MoveList() : n(0) {}
+
+    /*
+     * Builds the list from a mask with one bit set per move, in square order.
+     */
+    explicit MoveList(uint64_t mask) : n(0) {
+        while (mask) {
+            moves[n++] = Move(__builtin_ctzll(mask));
+            mask &= mask - 1;
+        }
+    }
+
+    int size() const { return n; }
+    bool empty() const { return n == 0; }
+    void push(Move m) { moves[n++] = m; }
+
+    /*
+     * Moves m (if present) to the front, keeping the others in order.
+     */
+    void moveToFront(Move m) {
+        for (int i = 0; i < n; i++) {
+            if (moves[i].sq == m.sq) {
+                for (; i > 0; i--) moves[i] = moves[i - 1];
+                moves[0] = m;
+                return;
+            }
+        }
     }
-    ~Move() {}
 
-    int getX() { return x; }
-    int getY() { return y; }
+    Move &operator[](int i) { return moves[i]; }
+    const Move &operator[](int i) const { return moves[i]; }
 
-    void setX(int x) { this->x = x; }
-    void setY(int y) { this->y = y; }
+private:
+    Move moves[CAPACITY];
+    int n;
 };
 
 #endif
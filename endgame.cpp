@@ -0,0 +1,427 @@
+#include "endgame.hpp"
+#include "bitboard.hpp"
+
+// With this many empties or fewer the solver uses searchSmall(), which hands
+// the empty squares to a routine for that exact number instead of
+// generating and ordering moves.
+#define SMALL_EMPTIES 4
+
+// From this many empties, nodes use the transposition table.
+#define TT_MIN_EMPTIES 8
+
+// From this many empties, moves are ordered fastest-first (fewest replies
+// for the opponent); closer to the end parity ordering alone is cheaper.
+#define FASTEST_FIRST_EMPTIES 7
+
+// How often (in nodes) the solver looks at the clock.
+#define CLOCK_CHECK_NODES 4096
+
+// The four 4x4 quadrants of the board.
+static constexpr uint64_t QUADRANTS[4] = {
+    0x000000000f0f0f0fULL, 0x00000000f0f0f0f0ULL,
+    0x0f0f0f0f00000000ULL, 0xf0f0f0f000000000ULL
+};
+
+/*
+ * Squares in quadrants with an odd number of empties. The last move in a
+ * region is an advantage, so these are tried first (parity ordering).
+ */
+static inline uint64_t oddQuadrants(uint64_t empty) {
+    uint64_t odd = 0;
+    for (int i = 0; i < 4; i++) {
+        if (__builtin_popcountll(empty & QUADRANTS[i]) & 1) {
+            odd |= QUADRANTS[i];
+        }
+    }
+    return odd;
+}
+
+/*
+ * Final score when neither side can move: the disc difference for P, with
+ * the empty squares going to the winner.
+ */
+static inline int finalScore(uint64_t P, uint64_t O) {
+    int p = __builtin_popcountll(P);
+    int o = __builtin_popcountll(O);
+    int diff = p - o;
+    if (diff > 0) return diff + (64 - p - o);
+    if (diff < 0) return diff - (64 - p - o);
+    return 0;
+}
+
+/*
+ * Hash of a position for the transposition table. It is unrelated to the
+ * Zobrist hashes of the midgame search, so endgame entries (exact disc
+ * differences) never answer midgame probes.
+ */
+static inline uint64_t hashPosition(uint64_t P, uint64_t O) {
+    uint64_t h = P * 0x9e3779b97f4a7c15ULL;
+    h ^= (O + 0x632be59bd9b4e019ULL) * 0xc2b2ae3d27d4eb4fULL;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    return h ^ (h >> 32);
+}
+
+/*
+ * Make a solver that shares the given transposition table.
+ */
+EndgameSolver::EndgameSolver(TranspositionTable *tt) {
+    this->tt = tt;
+    timed = false;
+    cancel = nullptr;
+    aborted = false;
+    nodes = 0;
+}
+
+/*
+ * Destructor for the solver.
+ */
+EndgameSolver::~EndgameSolver() {
+}
+
+/*
+ * Makes the solver give up (setting "aborted") once the deadline passes.
+ */
+void EndgameSolver::setDeadline(chrono::steady_clock::time_point deadline) {
+    this->deadline = deadline;
+    timed = true;
+}
+
+/*
+ * Makes the solver give up (setting "aborted") once the flag is set, which
+ * another thread may do at any time.
+ */
+void EndgameSolver::setCancelFlag(const atomic<bool> *cancel) {
+    this->cancel = cancel;
+}
+
+bool EndgameSolver::timeUp() {
+    if (!aborted && nodes % CLOCK_CHECK_NODES == 0) {
+        if ((cancel && cancel->load(memory_order_relaxed)) ||
+            (timed && chrono::steady_clock::now() >= deadline)) {
+            aborted = true;
+        }
+    }
+    return aborted;
+}
+
+/*
+ * Solves the position for P (to move) within the window (alpha, beta) and
+ * returns its score, with the best move's square in bestMove (-1 if P has to
+ * pass or the search was aborted). If every move fails low (the score is at
+ * most alpha) bestMove is only the one with the highest bound.
+ */
+int EndgameSolver::solve(uint64_t P, uint64_t O, int alpha, int beta,
+                         int &bestMove) {
+    bestMove = -1;
+    uint64_t moves = legalMoves(P, O);
+    if (moves == 0) {
+        return search(P, O, alpha, beta, false);
+    }
+
+    // Order the root moves fastest-first, whatever the number of empties.
+    int squares[64];
+    int keys[64];
+    int n = 0;
+    while (moves) {
+        int sq = __builtin_ctzll(moves);
+        moves &= moves - 1;
+        uint64_t f = flips(P, O, 1ULL << sq);
+        uint64_t next = legalMoves(O & ~f, P | f | (1ULL << sq));
+        keys[n] = -__builtin_popcountll(next);
+        squares[n++] = sq;
+    }
+
+    int best = -65;
+    for (int i = 0; i < n; i++) {
+        int b = i;
+        for (int j = i + 1; j < n; j++) {
+            if (keys[j] > keys[b]) b = j;
+        }
+        int sq = squares[b];
+        squares[b] = squares[i];
+        keys[b] = keys[i];
+
+        uint64_t f = flips(P, O, 1ULL << sq);
+        uint64_t P2 = P | f | (1ULL << sq);
+        uint64_t O2 = O & ~f;
+        int score;
+        if (i == 0) {
+            score = -search(O2, P2, -beta, -alpha, false);
+        } else {
+            score = -search(O2, P2, -alpha - 1, -alpha, false);
+            if (score > alpha && score < beta) {
+                score = -search(O2, P2, -beta, -alpha, false);
+            }
+        }
+        if (aborted) {
+            bestMove = -1;
+            return 0;
+        }
+
+        if (score > best) {
+            best = score;
+            bestMove = sq;
+        }
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+    return best;
+}
+
+/*
+ * Principal variation search to the end of the game. Nodes far enough from
+ * the end use the transposition table, a stability cutoff and fastest-first
+ * ordering; the last few empties are handed to searchSmall().
+ */
+int EndgameSolver::search(uint64_t P, uint64_t O, int alpha, int beta,
+                          bool passed) {
+    nodes++;
+    if (timeUp()) return 0;
+
+    uint64_t empty = ~(P | O);
+    int empties = __builtin_popcountll(empty);
+    if (empties <= SMALL_EMPTIES) {
+        return searchSmall(P, O, alpha, beta, empty, passed);
+    }
+
+    uint64_t moves = legalMoves(P, O);
+    if (moves == 0) {
+        if (passed) return finalScore(P, O);
+        return -search(O, P, -beta, -alpha, true);
+    }
+
+    // The opponent's stable stones cap how well P can do. That can only cut
+    // if alpha is above what all of the opponent's stones would allow.
+    if (alpha >= 64 - 2 * __builtin_popcountll(O)) {
+        int upper = 64 - 2 * __builtin_popcountll(stableDiscs(O, P));
+        if (upper <= alpha) return upper;
+    }
+
+    uint64_t key = 0;
+    int ttMove = -1;
+    if (empties >= TT_MIN_EMPTIES) {
+        key = hashPosition(P, O);
+        TTEntry entry;
+        if (tt->probe(key, entry)) {
+            ttMove = entry.move;
+            if (entry.bound == BOUND_EXACT ||
+                (entry.bound == BOUND_LOWER && entry.score >= beta) ||
+                (entry.bound == BOUND_UPPER && entry.score <= alpha)) {
+                return entry.score;
+            }
+        }
+    }
+
+    // Sort keys: table move, then fastest-first, then parity; corners are
+    // always worth trying early.
+    uint64_t odd = oddQuadrants(empty);
+    bool fastest = (empties >= FASTEST_FIRST_EMPTIES);
+    int squares[64];
+    int keys[64];
+    int n = 0;
+    while (moves) {
+        int sq = __builtin_ctzll(moves);
+        moves &= moves - 1;
+        uint64_t bit = 1ULL << sq;
+        int key = ((odd & bit) ? 2 : 0) + ((bit & 0x8100000000000081ULL) ? 4 : 0);
+        if (sq == ttMove) {
+            key = 1 << 20;
+        } else if (fastest) {
+            uint64_t f = flips(P, O, bit);
+            uint64_t next = legalMoves(O & ~f, P | f | bit);
+            key -= 16 * __builtin_popcountll(next);
+        }
+        keys[n] = key;
+        squares[n++] = sq;
+    }
+
+    int alpha0 = alpha;
+    int best = -65;
+    int bestMove = -1;
+    for (int i = 0; i < n; i++) {
+        int b = i;
+        for (int j = i + 1; j < n; j++) {
+            if (keys[j] > keys[b]) b = j;
+        }
+        int sq = squares[b];
+        squares[b] = squares[i];
+        keys[b] = keys[i];
+
+        uint64_t f = flips(P, O, 1ULL << sq);
+        uint64_t P2 = P | f | (1ULL << sq);
+        uint64_t O2 = O & ~f;
+        int score;
+        if (i == 0) {
+            score = -search(O2, P2, -beta, -alpha, false);
+        } else {
+            score = -search(O2, P2, -alpha - 1, -alpha, false);
+            if (score > alpha && score < beta) {
+                score = -search(O2, P2, -beta, -alpha, false);
+            }
+        }
+
+        if (score > best) {
+            best = score;
+            bestMove = sq;
+        }
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+
+    if (key && !aborted) {
+        Bound bound = BOUND_EXACT;
+        if (best <= alpha0) bound = BOUND_UPPER;
+        else if (best >= beta) bound = BOUND_LOWER;
+        tt->store(key, empties, best, bound, bestMove);
+    }
+    return best;
+}
+
+/*
+ * The last few empties: picks out the empty squares, odd quadrants first
+ * (parity ordering), and hands them to the routine for that many.
+ */
+int EndgameSolver::searchSmall(uint64_t P, uint64_t O, int alpha, int beta,
+                               uint64_t empty, bool passed) {
+    uint64_t odd = oddQuadrants(empty);
+    int x[SMALL_EMPTIES];
+    int n = 0;
+    for (uint64_t squares = empty & odd; squares; squares &= squares - 1) {
+        x[n++] = __builtin_ctzll(squares);
+    }
+    for (uint64_t squares = empty & ~odd; squares; squares &= squares - 1) {
+        x[n++] = __builtin_ctzll(squares);
+    }
+
+    switch (n) {
+    case 4:
+        return search4(P, O, alpha, beta, x[0], x[1], x[2], x[3], passed);
+    case 3:
+        return search3(P, O, alpha, beta, x[0], x[1], x[2], passed);
+    case 2:
+        return search2(P, O, alpha, beta, x[0], x[1], passed);
+    case 1:
+        return searchLast(P, O, x[0]);
+    default:
+        return finalScore(P, O);
+    }
+}
+
+/*
+ * Four empties x1..x4, tried in that order; each move leaves the other
+ * three, in order, to search3().
+ */
+int EndgameSolver::search4(uint64_t P, uint64_t O, int alpha, int beta,
+                           int x1, int x2, int x3, int x4, bool passed) {
+    nodes++;
+    int best = -65;
+    const int x[4] = { x1, x2, x3, x4 };
+    for (int i = 0; i < 4; i++) {
+        uint64_t bit = 1ULL << x[i];
+        uint64_t f = flips(P, O, bit);
+        if (f == 0) continue;
+
+        int a = x[i == 0 ? 1 : 0];
+        int b = x[i <= 1 ? 2 : 1];
+        int c = x[i <= 2 ? 3 : 2];
+        int score = -search3(O & ~f, P | f | bit, -beta, -alpha, a, b, c,
+                             false);
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) return best;
+            }
+        }
+    }
+
+    if (best == -65) {
+        if (passed) return finalScore(P, O);
+        return -search4(O, P, -beta, -alpha, x1, x2, x3, x4, true);
+    }
+    return best;
+}
+
+/*
+ * Three empties x1..x3, tried in that order; each move leaves the other two
+ * to search2().
+ */
+int EndgameSolver::search3(uint64_t P, uint64_t O, int alpha, int beta,
+                           int x1, int x2, int x3, bool passed) {
+    nodes++;
+    int best = -65;
+    const int x[3] = { x1, x2, x3 };
+    for (int i = 0; i < 3; i++) {
+        uint64_t bit = 1ULL << x[i];
+        uint64_t f = flips(P, O, bit);
+        if (f == 0) continue;
+
+        int a = x[i == 0 ? 1 : 0];
+        int b = x[i <= 1 ? 2 : 1];
+        int score = -search2(O & ~f, P | f | bit, -beta, -alpha, a, b, false);
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) return best;
+            }
+        }
+    }
+
+    if (best == -65) {
+        if (passed) return finalScore(P, O);
+        return -search3(O, P, -beta, -alpha, x1, x2, x3, true);
+    }
+    return best;
+}
+
+/*
+ * Two empties x1 and x2: each move leaves the other square to searchLast(),
+ * whose score is exact, so only beta matters.
+ */
+int EndgameSolver::search2(uint64_t P, uint64_t O, int alpha, int beta,
+                           int x1, int x2, bool passed) {
+    nodes++;
+    int best = -65;
+
+    uint64_t bit = 1ULL << x1;
+    uint64_t f = flips(P, O, bit);
+    if (f) {
+        best = -searchLast(O & ~f, P | f | bit, x2);
+        if (best >= beta) return best;
+    }
+
+    bit = 1ULL << x2;
+    f = flips(P, O, bit);
+    if (f) {
+        int score = -searchLast(O & ~f, P | f | bit, x1);
+        if (score > best) best = score;
+    }
+
+    if (best == -65) {
+        if (passed) return finalScore(P, O);
+        return -search2(O, P, -beta, -alpha, x1, x2, true);
+    }
+    return best;
+}
+
+/*
+ * Score with a single empty square left: whoever can play there does (P
+ * first), and otherwise it goes to the winner.
+ */
+int EndgameSolver::searchLast(uint64_t P, uint64_t O, int sq) {
+    nodes++;
+    uint64_t bit = 1ULL << sq;
+    int diff = __builtin_popcountll(P) - __builtin_popcountll(O);
+
+    uint64_t f = flips(P, O, bit);
+    if (f) return diff + 2 * __builtin_popcountll(f) + 1;
+
+    f = flips(O, P, bit);
+    if (f) return diff - 2 * __builtin_popcountll(f) - 1;
+
+    if (diff > 0) return diff + 1;
+    if (diff < 0) return diff - 1;
+    return 0;
+}
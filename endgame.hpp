@@ -0,0 +1,51 @@
+#ifndef __ENDGAME_H__
+#define __ENDGAME_H__
+
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+#include "common.hpp"
+#include "ttable.hpp"
+using namespace std;
+
+/*
+ * Exact endgame search on raw bitboards. Scores are final disc differences
+ * for the side to move, with empty squares counted for the winner. Searching
+ * with the window (-1, 1) only settles win, loss or draw, which is much
+ * faster.
+ */
+class EndgameSolver {
+
+private:
+    TranspositionTable *tt;
+    bool timed;
+    chrono::steady_clock::time_point deadline;
+    const atomic<bool> *cancel;
+
+    int search(uint64_t P, uint64_t O, int alpha, int beta, bool passed);
+    int searchSmall(uint64_t P, uint64_t O, int alpha, int beta,
+                    uint64_t empty, bool passed);
+    int search4(uint64_t P, uint64_t O, int alpha, int beta,
+                int x1, int x2, int x3, int x4, bool passed);
+    int search3(uint64_t P, uint64_t O, int alpha, int beta,
+                int x1, int x2, int x3, bool passed);
+    int search2(uint64_t P, uint64_t O, int alpha, int beta,
+                int x1, int x2, bool passed);
+    int searchLast(uint64_t P, uint64_t O, int sq);
+    bool timeUp();
+
+public:
+    EndgameSolver(TranspositionTable *tt);
+    ~EndgameSolver();
+
+    void setDeadline(chrono::steady_clock::time_point deadline);
+    void setCancelFlag(const atomic<bool> *cancel);
+    int solve(uint64_t P, uint64_t O, int alpha, int beta, int &bestMove);
+
+    // Set once the deadline passes or the search is cancelled; the search
+    // result is then meaningless
+    bool aborted;
+    long nodes;
+};
+
+#endif
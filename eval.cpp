@@ -0,0 +1,720 @@
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "eval.hpp"
+#include "bitboard.hpp"
+#include "simd.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Weights file format: the magic bytes, a version, the number of phases,
+// pattern types and other terms, the number of squares of each type, then
+// every weight as a little-endian int16_t: the patterns phase by phase and
+// type by type, then the other terms phase by phase. Version 1 files have no
+// other terms.
+#define WEIGHTS_MAGIC "OTHW"
+#define WEIGHTS_VERSION 2
+
+// Positions that evaluateBatch() scores together.
+#define EVAL_BATCH 64
+
+// The AVX2 kernel reads weights as aligned pairs, which stay inside the
+// table only if it has an even number of them.
+static_assert(EVAL_PHASES % 2 == 0, "the weight table must have even size");
+
+// Default weights of the mobility, potential mobility and stability terms,
+// per move, square or disc of difference, picked by self-play matches.
+static constexpr int16_t DEFAULT_FEATURE_WEIGHTS[EVAL_FEATURES] = {
+    128, 48, 256
+};
+
+/*
+ * Square values of the old weighted-square evaluation. The default pattern
+ * weights are built from them, so an untrained evaluation plays like it.
+ */
+static constexpr int SQUARE_WEIGHTS[64] = {
+    1000,   50,  100,  100,  100,  100,   50, 1000,
+      50,  -20,  -10,  -10,  -10,  -10,  -20,   50,
+     100,  -10,    1,    1,    1,    1,  -10,  100,
+     100,  -10,    1,    1,    1,    1,  -10,  100,
+     100,  -10,    1,    1,    1,    1,  -10,  100,
+     100,  -10,    1,    1,    1,    1,  -10,  100,
+      50,  -20,  -10,  -10,  -10,  -10,  -20,   50,
+    1000,   50,  100,  100,  100,  100,   50, 1000
+};
+
+/*
+ * One placement of each pattern type as (x, y) pairs; the others are its
+ * images under the 8 board symmetries.
+ */
+struct PatternShape {
+    int size;
+    int cells[PATTERN_MAX_SQUARES][2];
+};
+
+static constexpr PatternShape SHAPES[PATTERN_TYPES] = {
+    // Edge with both X-squares
+    { 10, {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {5, 0}, {6, 0}, {7, 0},
+           {1, 1}, {6, 1}} },
+    // 3x3 corner
+    { 9, {{0, 0}, {1, 0}, {2, 0}, {0, 1}, {1, 1}, {2, 1}, {0, 2}, {1, 2},
+          {2, 2}} },
+    // 2x5 corner
+    { 10, {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {0, 1}, {1, 1}, {2, 1},
+           {3, 1}, {4, 1}} },
+    // Second, third and fourth rows
+    { 8, {{0, 1}, {1, 1}, {2, 1}, {3, 1}, {4, 1}, {5, 1}, {6, 1}, {7, 1}} },
+    { 8, {{0, 2}, {1, 2}, {2, 2}, {3, 2}, {4, 2}, {5, 2}, {6, 2}, {7, 2}} },
+    { 8, {{0, 3}, {1, 3}, {2, 3}, {3, 3}, {4, 3}, {5, 3}, {6, 3}, {7, 3}} },
+    // Diagonals of length 8 down to 4
+    { 8, {{0, 0}, {1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}, {6, 6}, {7, 7}} },
+    { 7, {{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 6}, {6, 7}} },
+    { 6, {{0, 2}, {1, 3}, {2, 4}, {3, 5}, {4, 6}, {5, 7}} },
+    { 5, {{0, 3}, {1, 4}, {2, 5}, {3, 6}, {4, 7}} },
+    { 4, {{0, 4}, {1, 5}, {2, 6}, {3, 7}} }
+};
+
+/*
+ * Maps a square to its image under one of the 8 board symmetries.
+ */
+static int transform(int s, int x, int y) {
+    if (s & 1) x = 7 - x;
+    if (s & 2) y = 7 - y;
+    if (s & 4) return y + 8 * x;
+    return x + 8 * y;
+}
+
+/*
+ * Stops the program when the pattern shapes do not fit the fixed-size tables
+ * of eval.hpp. Dropping a placement instead would make incremental updates
+ * quietly disagree with a full evaluation.
+ */
+static void patternTablesTooSmall(const char *limit, int needed) {
+    fprintf(stderr, "Pattern shapes need %s of at least %d\n", limit, needed);
+    abort();
+}
+
+/*
+ * All placements of all pattern types, and the layout of their weights.
+ */
+struct PatternSet {
+    PatternInstance instances[PATTERN_INSTANCES];
+    int count;
+
+    // Start of each type's table within a phase, and the size of a phase
+    int offset[PATTERN_TYPES];
+    int phaseSize;
+
+    // Start of each placement's table within a phase
+    int instanceOffset[PATTERN_INSTANCES];
+
+    // Symmetries that map a type onto itself, as permutations of its digits
+    // (perm[k] is where digit k goes); the identity is left out.
+    vector<vector<int> > selfMaps[PATTERN_TYPES];
+
+    PatternSet() {
+        count = 0;
+        phaseSize = 0;
+        for (int t = 0; t < PATTERN_TYPES; t++) {
+            const PatternShape &shape = SHAPES[t];
+            offset[t] = phaseSize;
+            phaseSize += pow3(shape.size);
+
+            int base[PATTERN_MAX_SQUARES];
+            uint64_t baseMask = 0;
+            for (int k = 0; k < shape.size; k++) {
+                base[k] = transform(0, shape.cells[k][0], shape.cells[k][1]);
+                baseMask |= 1ULL << base[k];
+            }
+
+            vector<uint64_t> placed;
+            for (int s = 0; s < 8; s++) {
+                PatternInstance inst;
+                inst.type = t;
+                inst.size = shape.size;
+                uint64_t mask = 0;
+                for (int k = 0; k < shape.size; k++) {
+                    inst.squares[k] = transform(s, shape.cells[k][0],
+                                                shape.cells[k][1]);
+                    mask |= 1ULL << inst.squares[k];
+                }
+
+                if (mask == baseMask && s != 0) {
+                    vector<int> perm(shape.size);
+                    for (int k = 0; k < shape.size; k++) {
+                        for (int j = 0; j < shape.size; j++) {
+                            if (inst.squares[k] == base[j]) perm[k] = j;
+                        }
+                    }
+                    selfMaps[t].push_back(perm);
+                }
+
+                bool seen = false;
+                for (uint64_t m : placed) {
+                    if (m == mask) seen = true;
+                }
+                if (!seen) {
+                    if (count == PATTERN_INSTANCES) {
+                        patternTablesTooSmall("PATTERN_INSTANCES", count + 1);
+                    }
+                    placed.push_back(mask);
+                    instanceOffset[count] = offset[t];
+                    instances[count++] = inst;
+                }
+            }
+        }
+        if (count != PATTERN_INSTANCES) {
+            fprintf(stderr, "Pattern shapes have %d placements, not "
+                    "PATTERN_INSTANCES (%d)\n", count, PATTERN_INSTANCES);
+            abort();
+        }
+
+        for (int i = 0; i < count; i++) {
+            const PatternInstance &inst = instances[i];
+            for (int k = 0; k < inst.size; k++) {
+                SquarePatterns &sp = PatternEval::squarePatterns[inst.squares[k]];
+                if (sp.count == SQUARE_MAX_PATTERNS) {
+                    patternTablesTooSmall("SQUARE_MAX_PATTERNS", sp.count + 1);
+                }
+                sp.instance[sp.count] = i;
+                sp.power[sp.count++] = pow3(inst.size - 1 - k);
+            }
+        }
+    }
+
+    static int pow3(int n) {
+        int p = 1;
+        while (n--) p *= 3;
+        return p;
+    }
+
+    // Index of the pattern with its digits moved by a self-symmetry
+    int mapIndex(int type, int index, const vector<int> &perm) const {
+        int size = SHAPES[type].size;
+        int digits[PATTERN_MAX_SQUARES];
+        for (int k = size - 1; k >= 0; k--) {
+            digits[k] = index % 3;
+            index /= 3;
+        }
+        int mapped[PATTERN_MAX_SQUARES];
+        for (int k = 0; k < size; k++) {
+            mapped[perm[k]] = digits[k];
+        }
+        int result = 0;
+        for (int k = 0; k < size; k++) {
+            result = result * 3 + mapped[k];
+        }
+        return result;
+    }
+};
+
+SquarePatterns PatternEval::squarePatterns[64];
+
+static const PatternSet PATTERNS;
+
+/*
+ * Make an evaluation with the default weights.
+ */
+PatternEval::PatternEval() {
+    weights.resize(EVAL_PHASES * PATTERNS.phaseSize);
+    whiteWeights.resize(weights.size());
+    featureWeights.resize(EVAL_PHASES * EVAL_FEATURES);
+    setDefaults();
+}
+
+/*
+ * Destructor for the evaluation.
+ */
+PatternEval::~PatternEval() {
+}
+
+/*
+ * Default weights: every pattern adds up the square values of its discs,
+ * each square's value split between the patterns that cover it. The sum over
+ * all patterns is then the weighted-square score, up to rounding.
+ */
+void PatternEval::setDefaults() {
+    int cover[64] = {0};
+    for (int i = 0; i < PATTERNS.count; i++) {
+        const PatternInstance &inst = PATTERNS.instances[i];
+        for (int k = 0; k < inst.size; k++) {
+            cover[inst.squares[k]]++;
+        }
+    }
+
+    for (int t = 0; t < PATTERN_TYPES; t++) {
+        // The first placement of each type is its shape as listed
+        const PatternInstance *inst = nullptr;
+        for (int i = 0; i < PATTERNS.count && !inst; i++) {
+            if (PATTERNS.instances[i].type == t) inst = &PATTERNS.instances[i];
+        }
+
+        int16_t *w = table(0, t);
+        int n = typeSize(t);
+        for (int index = 0; index < PatternSet::pow3(n); index++) {
+            double value = 0;
+            int rest = index;
+            for (int k = n - 1; k >= 0; k--) {
+                int sq = inst->squares[k];
+                int digit = rest % 3;
+                rest /= 3;
+                if (digit == 1) value += (double) SQUARE_WEIGHTS[sq] / cover[sq];
+                if (digit == 2) value -= (double) SQUARE_WEIGHTS[sq] / cover[sq];
+            }
+            w[index] = (int16_t) lround(value);
+        }
+    }
+
+    for (int phase = 1; phase < EVAL_PHASES; phase++) {
+        memcpy(table(phase, 0), table(0, 0),
+               PATTERNS.phaseSize * sizeof(int16_t));
+    }
+    for (int phase = 0; phase < EVAL_PHASES; phase++) {
+        memcpy(features(phase), DEFAULT_FEATURE_WEIGHTS,
+               sizeof(DEFAULT_FEATURE_WEIGHTS));
+    }
+    symmetrize();
+}
+
+/*
+ * Makes every weight equal to that of its mirror images under the symmetries
+ * that map a pattern onto itself, so that symmetric positions score the
+ * same. Trainers call this after changing weights through table(), as it
+ * also brings the weights for white up to date.
+ */
+void PatternEval::symmetrize() {
+    for (int t = 0; t < PATTERN_TYPES; t++) {
+        if (PATTERNS.selfMaps[t].empty()) continue;
+        int entries = PatternSet::pow3(typeSize(t));
+        for (int index = 0; index < entries; index++) {
+            int canonical = canonicalIndex(t, index);
+            if (canonical == index) continue;
+            for (int phase = 0; phase < EVAL_PHASES; phase++) {
+                table(phase, t)[index] = table(phase, t)[canonical];
+            }
+        }
+    }
+    mirrorColours();
+}
+
+/*
+ * The index whose weight all the mirror images of a pattern index share:
+ * the smallest of them.
+ */
+int PatternEval::canonicalIndex(int type, int index) {
+    int canonical = index;
+    for (const vector<int> &perm : PATTERNS.selfMaps[type]) {
+        int mapped = PATTERNS.mapIndex(type, index, perm);
+        if (mapped < canonical) canonical = mapped;
+    }
+    return canonical;
+}
+
+/*
+ * Fills in the weights for white: each index with the own and opponent
+ * digits swapped.
+ */
+void PatternEval::mirrorColours() {
+    for (int t = 0; t < PATTERN_TYPES; t++) {
+        int size = typeSize(t);
+        int entries = PatternSet::pow3(size);
+        for (int index = 0; index < entries; index++) {
+            int swapped = 0;
+            for (int k = 0, rest = index, power = 1; k < size; k++) {
+                int digit = rest % 3;
+                rest /= 3;
+                swapped += power * (digit ? 3 - digit : 0);
+                power *= 3;
+            }
+            for (int phase = 0; phase < EVAL_PHASES; phase++) {
+                int base = phase * PATTERNS.phaseSize + PATTERNS.offset[t];
+                whiteWeights[base + index] = weights[base + swapped];
+            }
+        }
+    }
+}
+
+/*
+ * Loads weights from a file written by save(). Returns false, keeping the
+ * current weights, if the file is missing or made for other patterns.
+ */
+bool PatternEval::load(const char *path) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+
+    char magic[4];
+    uint32_t header[3];
+    in.read(magic, 4);
+    in.read((char *) header, sizeof(header));
+    if (!in || memcmp(magic, WEIGHTS_MAGIC, 4) != 0 ||
+        (header[0] != 1 && header[0] != WEIGHTS_VERSION) ||
+        header[1] != EVAL_PHASES || header[2] != PATTERN_TYPES) {
+        return false;
+    }
+    uint32_t featureCount = 0;
+    if (header[0] >= 2) {
+        in.read((char *) &featureCount, sizeof(featureCount));
+        if (!in || featureCount != EVAL_FEATURES) return false;
+    }
+    for (int t = 0; t < PATTERN_TYPES; t++) {
+        uint32_t size;
+        in.read((char *) &size, sizeof(size));
+        if (!in || (int) size != typeSize(t)) return false;
+    }
+
+    vector<int16_t> loaded(weights.size());
+    in.read((char *) loaded.data(), loaded.size() * sizeof(int16_t));
+    if (!in) return false;
+
+    vector<int16_t> loadedFeatures(featureWeights);
+    if (featureCount) {
+        in.read((char *) loadedFeatures.data(),
+                loadedFeatures.size() * sizeof(int16_t));
+        if (!in) return false;
+    }
+
+    weights.swap(loaded);
+    featureWeights.swap(loadedFeatures);
+    symmetrize();
+    return true;
+}
+
+/*
+ * Writes the weights to a file in the format load() reads.
+ */
+bool PatternEval::save(const char *path) {
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+
+    uint32_t header[4] = { WEIGHTS_VERSION, EVAL_PHASES, PATTERN_TYPES,
+                           EVAL_FEATURES };
+    out.write(WEIGHTS_MAGIC, 4);
+    out.write((const char *) header, sizeof(header));
+    for (int t = 0; t < PATTERN_TYPES; t++) {
+        uint32_t size = typeSize(t);
+        out.write((const char *) &size, sizeof(size));
+    }
+    out.write((const char *) weights.data(), weights.size() * sizeof(int16_t));
+    out.write((const char *) featureWeights.data(),
+              featureWeights.size() * sizeof(int16_t));
+    return (bool) out;
+}
+
+/*
+ * The part of the score from the terms other than patterns.
+ */
+static inline int featureScore(const int16_t *w, uint64_t P, uint64_t O) {
+    int f[EVAL_FEATURES];
+    PatternEval::getFeatures(P, O, f);
+    int score = 0;
+    for (int i = 0; i < EVAL_FEATURES; i++) {
+        score += w[i] * f[i];
+    }
+    return score;
+}
+
+/*
+ * Scores the position for P, the side to move, working out every pattern
+ * index from scratch.
+ */
+int PatternEval::evaluate(uint64_t P, uint64_t O) {
+    int phase = getPhase(__builtin_popcountll(P | O));
+    const int16_t *w = table(phase, 0);
+    int score = featureScore(features(phase), P, O);
+    int indices[PATTERN_INSTANCES];
+    getIndices(P, O, indices);
+    for (int i = 0; i < PATTERN_INSTANCES; i++) {
+        score += w[PATTERNS.instanceOffset[i] + indices[i]];
+    }
+
+    if (score > EVAL_MAX) return EVAL_MAX;
+    if (score < -EVAL_MAX) return -EVAL_MAX;
+    return score;
+}
+
+/*
+ * Scores a position for the given side from pattern indices kept up to date
+ * by a BoardState, where black discs are the 1 digits and white discs the 2s.
+ */
+template <Side side>
+int PatternEval::evaluate(const uint16_t *patterns, uint64_t P, uint64_t O) {
+    int phase = getPhase(__builtin_popcountll(P | O));
+    const vector<int16_t> &sideWeights = (side == BLACK) ? weights : whiteWeights;
+    const int16_t *w = &sideWeights[phase * PATTERNS.phaseSize];
+    int score = featureScore(features(phase), P, O);
+    for (int i = 0; i < PATTERN_INSTANCES; i++) {
+        score += w[PATTERNS.instanceOffset[i] + patterns[i]];
+    }
+
+    if (score > EVAL_MAX) return EVAL_MAX;
+    if (score < -EVAL_MAX) return -EVAL_MAX;
+    return score;
+}
+
+template int PatternEval::evaluate<BLACK>(const uint16_t *patterns,
+                                          uint64_t P, uint64_t O);
+template int PatternEval::evaluate<WHITE>(const uint16_t *patterns,
+                                          uint64_t P, uint64_t O);
+
+/*
+ * The same, for P of the given colour.
+ */
+int PatternEval::evaluate(const uint16_t *patterns, uint64_t P, uint64_t O,
+                          Side side) {
+    return (side == BLACK) ? evaluate<BLACK>(patterns, P, O)
+                           : evaluate<WHITE>(patterns, P, O);
+}
+
+/*
+ * Pattern part of the score of n positions, from scratch, with the given
+ * start of each one's phase in the weight table.
+ */
+static void patternScores(const int16_t *weights, const uint64_t *P,
+                          const uint64_t *O, const int *base, int *scores,
+                          int n) {
+    for (int j = 0; j < n; j++) {
+        int indices[PATTERN_INSTANCES];
+        PatternEval::getIndices(P[j], O[j], indices);
+        const int16_t *w = weights + base[j];
+        int score = 0;
+        for (int i = 0; i < PATTERN_INSTANCES; i++) {
+            score += w[PATTERNS.instanceOffset[i] + indices[i]];
+        }
+        scores[j] = score;
+    }
+}
+
+#ifdef SIMD_X86
+
+/*
+ * The same for eight positions at a time, one per 32-bit lane: the digit of
+ * every square is worked out once, each index is built by multiply-adds of
+ * those digits, and the weights are gathered as the aligned pair of int16_t
+ * that holds each one.
+ */
+__attribute__((target("avx2")))
+static void patternScoresAvx2(const int16_t *weights, const uint64_t *P,
+                              const uint64_t *O, const int *base,
+                              int *scores, int n) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i three = _mm256_set1_epi32(3);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        uint32_t words[4][8];
+        for (int k = 0; k < 8; k++) {
+            words[0][k] = (uint32_t) P[j + k];
+            words[1][k] = (uint32_t) (P[j + k] >> 32);
+            words[2][k] = (uint32_t) O[j + k];
+            words[3][k] = (uint32_t) (O[j + k] >> 32);
+        }
+        __m256i half[4];
+        for (int h = 0; h < 4; h++) {
+            half[h] = _mm256_loadu_si256((const __m256i *) words[h]);
+        }
+
+        __m256i digits[64];
+        for (int sq = 0; sq < 64; sq++) {
+            __m128i shift = _mm_cvtsi32_si128(sq & 31);
+            __m256i p = _mm256_and_si256(
+                _mm256_srl_epi32(half[sq >> 5], shift), one);
+            __m256i o = _mm256_and_si256(
+                _mm256_srl_epi32(half[2 + (sq >> 5)], shift), one);
+            digits[sq] = _mm256_add_epi32(p, _mm256_slli_epi32(o, 1));
+        }
+
+        __m256i phase = _mm256_loadu_si256((const __m256i *) (base + j));
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < PATTERN_INSTANCES; i++) {
+            const PatternInstance &inst = PATTERNS.instances[i];
+            __m256i index = digits[inst.squares[0]];
+            for (int k = 1; k < inst.size; k++) {
+                index = _mm256_add_epi32(_mm256_mullo_epi32(index, three),
+                                         digits[inst.squares[k]]);
+            }
+            __m256i at = _mm256_add_epi32(
+                index, _mm256_add_epi32(
+                    phase, _mm256_set1_epi32(PATTERNS.instanceOffset[i])));
+            __m256i pair = _mm256_i32gather_epi32(
+                (const int *) weights, _mm256_srli_epi32(at, 1), 4);
+            __m256i w = _mm256_srlv_epi32(
+                pair, _mm256_slli_epi32(_mm256_and_si256(at, one), 4));
+            w = _mm256_srai_epi32(_mm256_slli_epi32(w, 16), 16);
+            sum = _mm256_add_epi32(sum, w);
+        }
+        _mm256_storeu_si256((__m256i *) (scores + j), sum);
+    }
+    patternScores(weights, P + j, O + j, base + j, scores + j, n - j);
+}
+
+/*
+ * Four positions at a time with SSE2, which has no gathers: the indices are
+ * built in lanes and the weights looked up one by one.
+ */
+__attribute__((target("sse2")))
+static void patternScoresSse2(const int16_t *weights, const uint64_t *P,
+                              const uint64_t *O, const int *base,
+                              int *scores, int n) {
+    const __m128i one = _mm_set1_epi32(1);
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        uint32_t words[4][4];
+        for (int k = 0; k < 4; k++) {
+            words[0][k] = (uint32_t) P[j + k];
+            words[1][k] = (uint32_t) (P[j + k] >> 32);
+            words[2][k] = (uint32_t) O[j + k];
+            words[3][k] = (uint32_t) (O[j + k] >> 32);
+        }
+        __m128i half[4];
+        for (int h = 0; h < 4; h++) {
+            half[h] = _mm_loadu_si128((const __m128i *) words[h]);
+        }
+
+        __m128i digits[64];
+        for (int sq = 0; sq < 64; sq++) {
+            __m128i shift = _mm_cvtsi32_si128(sq & 31);
+            __m128i p = _mm_and_si128(_mm_srl_epi32(half[sq >> 5], shift),
+                                      one);
+            __m128i o = _mm_and_si128(
+                _mm_srl_epi32(half[2 + (sq >> 5)], shift), one);
+            digits[sq] = _mm_add_epi32(p, _mm_slli_epi32(o, 1));
+        }
+
+        int sum[4] = {0, 0, 0, 0};
+        for (int i = 0; i < PATTERN_INSTANCES; i++) {
+            const PatternInstance &inst = PATTERNS.instances[i];
+            __m128i index = digits[inst.squares[0]];
+            for (int k = 1; k < inst.size; k++) {
+                __m128i twice = _mm_add_epi32(index, index);
+                index = _mm_add_epi32(_mm_add_epi32(twice, index),
+                                      digits[inst.squares[k]]);
+            }
+            int at[4];
+            _mm_storeu_si128((__m128i *) at, index);
+            for (int k = 0; k < 4; k++) {
+                sum[k] += weights[base[j + k] + PATTERNS.instanceOffset[i] +
+                                  at[k]];
+            }
+        }
+        for (int k = 0; k < 4; k++) scores[j + k] = sum[k];
+    }
+    patternScores(weights, P + j, O + j, base + j, scores + j, n - j);
+}
+
+#endif
+
+/*
+ * Scores n positions at once, each for its own P against its own O, the
+ * same as evaluate(P[i], O[i]) would: the children of a node, say, or a
+ * queue of leaves. The pattern indices are built in SIMD lanes, and the
+ * mobility of a whole block of positions is found together.
+ */
+void PatternEval::evaluateBatch(const uint64_t *P, const uint64_t *O,
+                                int *scores, int n) {
+    for (int start = 0; start < n; start += EVAL_BATCH) {
+        int count = (n - start < EVAL_BATCH) ? n - start : EVAL_BATCH;
+        const uint64_t *p = P + start;
+        const uint64_t *o = O + start;
+        int *s = scores + start;
+
+        int phases[EVAL_BATCH], base[EVAL_BATCH];
+        for (int i = 0; i < count; i++) {
+            phases[i] = getPhase(__builtin_popcountll(p[i] | o[i]));
+            base[i] = phases[i] * PATTERNS.phaseSize;
+        }
+        switch (getSimdLevel()) {
+#ifdef SIMD_X86
+            case SIMD_AVX2:
+                patternScoresAvx2(weights.data(), p, o, base, s, count);
+                break;
+            case SIMD_SSE2:
+                patternScoresSse2(weights.data(), p, o, base, s, count);
+                break;
+#endif
+            default:
+                patternScores(weights.data(), p, o, base, s, count);
+                break;
+        }
+
+        uint64_t mine[EVAL_BATCH], theirs[EVAL_BATCH];
+        legalMovesBatch(p, o, mine, count);
+        legalMovesBatch(o, p, theirs, count);
+        for (int i = 0; i < count; i++) {
+            int f[EVAL_FEATURES];
+            f[FEATURE_MOBILITY] = __builtin_popcountll(mine[i]) -
+                                  __builtin_popcountll(theirs[i]);
+            f[FEATURE_POTENTIAL_MOBILITY] =
+                potentialMobility(p[i], o[i]) - potentialMobility(o[i], p[i]);
+            f[FEATURE_STABILITY] =
+                __builtin_popcountll(stableDiscs(p[i], o[i])) -
+                __builtin_popcountll(stableDiscs(o[i], p[i]));
+
+            const int16_t *w = features(phases[i]);
+            int score = s[i];
+            for (int k = 0; k < EVAL_FEATURES; k++) score += w[k] * f[k];
+            if (score > EVAL_MAX) score = EVAL_MAX;
+            if (score < -EVAL_MAX) score = -EVAL_MAX;
+            s[i] = score;
+        }
+    }
+}
+
+/*
+ * The index of every pattern placement, with P's discs as the 1 digits.
+ */
+void PatternEval::getIndices(uint64_t P, uint64_t O, int *indices) {
+    for (int i = 0; i < PATTERN_INSTANCES; i++) {
+        const PatternInstance &inst = PATTERNS.instances[i];
+        int index = 0;
+        for (int k = 0; k < inst.size; k++) {
+            int sq = inst.squares[k];
+            index = index * 3 + (int) ((P >> sq) & 1) +
+                    2 * (int) ((O >> sq) & 1);
+        }
+        indices[i] = index;
+    }
+}
+
+/*
+ * Differences, P minus O, in mobility, potential mobility and stable discs.
+ */
+void PatternEval::getFeatures(uint64_t P, uint64_t O, int *features) {
+    features[FEATURE_MOBILITY] = mobility(P, O) - mobility(O, P);
+    features[FEATURE_POTENTIAL_MOBILITY] =
+        potentialMobility(P, O) - potentialMobility(O, P);
+    features[FEATURE_STABILITY] = __builtin_popcountll(stableDiscs(P, O)) -
+                                  __builtin_popcountll(stableDiscs(O, P));
+}
+
+/*
+ * The weights of the terms other than patterns in one phase.
+ */
+int16_t *PatternEval::features(int phase) {
+    return &featureWeights[phase * EVAL_FEATURES];
+}
+
+/*
+ * The weights of one pattern type in one phase, by pattern index.
+ */
+int16_t *PatternEval::table(int phase, int type) {
+    return &weights[phase * PATTERNS.phaseSize + PATTERNS.offset[type]];
+}
+
+/*
+ * Weight set used for a position, from the number of discs on the board.
+ */
+int PatternEval::getPhase(int discs) {
+    return (discs - 4) * EVAL_PHASES / 61;
+}
+
+const PatternInstance &PatternEval::instance(int i) {
+    return PATTERNS.instances[i];
+}
+
+int PatternEval::typeSize(int type) {
+    return SHAPES[type].size;
+}
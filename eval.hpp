@@ -0,0 +1,111 @@
+#ifndef __EVAL_H__
+#define __EVAL_H__
+
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+using namespace std;
+
+// Number of pattern types, and of their placements on the board.
+#define PATTERN_TYPES 11
+#define PATTERN_INSTANCES 46
+
+// Most squares in one pattern.
+#define PATTERN_MAX_SQUARES 10
+
+// Most pattern placements that one square belongs to.
+#define SQUARE_MAX_PATTERNS 8
+
+// Weight sets, one per stage of the game (by number of discs).
+#define EVAL_PHASES 12
+
+// Terms added to the patterns, with one weight per phase each: the
+// differences in mobility, potential mobility and stable discs between the
+// side to move and its opponent.
+#define EVAL_FEATURES 3
+
+enum EvalFeature {
+    FEATURE_MOBILITY, FEATURE_POTENTIAL_MOBILITY, FEATURE_STABILITY
+};
+
+// Trained weights are in 1/EVAL_SCALE discs of final disc difference, and
+// evaluations are clamped to what a real disc difference can be.
+#define EVAL_SCALE 128
+#define EVAL_MAX (64 * EVAL_SCALE)
+
+/*
+ * One placement of a pattern type on the board. Its index is the base-3
+ * number with one digit per square, the first square most significant:
+ * 0 empty, 1 own disc, 2 opponent disc.
+ */
+struct PatternInstance {
+    int type;
+    int size;
+    int squares[PATTERN_MAX_SQUARES];
+};
+
+/*
+ * The pattern placements a square belongs to, with the place value of the
+ * square's digit in each. Boards use this to keep their pattern indices up
+ * to date as discs are placed and flipped.
+ */
+struct SquarePatterns {
+    int count;
+    uint8_t instance[SQUARE_MAX_PATTERNS];
+    uint16_t power[SQUARE_MAX_PATTERNS];
+};
+
+/*
+ * Pattern evaluation: edges with the X-squares, 3x3 and 2x5 corners, the
+ * rows and columns, and the diagonals of length 4 to 8. Every placement of a
+ * pattern type (its rotations and reflections) shares one weight table, so
+ * symmetric positions always score the same. Mobility and stability terms
+ * are added on top.
+ */
+class PatternEval {
+
+private:
+    // Weights for each phase, type and pattern index
+    vector<int16_t> weights;
+
+    // The same weights indexed with white's discs as the own ones, for
+    // scoring white from the indices a Board keeps (where black is 1)
+    vector<int16_t> whiteWeights;
+
+    // Weights of the EVAL_FEATURES terms for each phase
+    vector<int16_t> featureWeights;
+
+    void setDefaults();
+    void mirrorColours();
+
+public:
+    PatternEval();
+    ~PatternEval();
+
+    bool load(const char *path);
+    bool save(const char *path);
+    void symmetrize();
+
+    int evaluate(uint64_t P, uint64_t O);
+    int evaluate(const uint16_t *patterns, uint64_t P, uint64_t O, Side side);
+    template <Side side>
+    int evaluate(const uint16_t *patterns, uint64_t P, uint64_t O);
+    void evaluateBatch(const uint64_t *P, const uint64_t *O, int *scores,
+                       int n);
+
+    int16_t *table(int phase, int type);
+    int16_t *features(int phase);
+
+    static void getIndices(uint64_t P, uint64_t O, int *indices);
+    static void getFeatures(uint64_t P, uint64_t O, int *features);
+    static int canonicalIndex(int type, int index);
+
+    static int getPhase(int discs);
+    static const PatternInstance &instance(int i);
+    static int typeSize(int type);
+
+    // For each square, the patterns it is part of
+    static SquarePatterns squarePatterns[64];
+};
+
+#endif
@@ -0,0 +1,478 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "common.hpp"
+#include "board.hpp"
+#include "player.hpp"
+#include "endgame.hpp"
+#include "eval.hpp"
+#include "samples.hpp"
+using namespace std;
+
+// Games open with this many random moves, and later moves are random with
+// this chance (in percent), so the games spread over many positions.
+#define RANDOM_PLIES 8
+#define RANDOM_MOVE_PERCENT 10
+
+// Positions with this many empty squares or fewer are labelled (and played)
+// by the exact endgame solver; earlier ones by a full-width search.
+#define EXACT_EMPTIES 14
+
+// Hash table of each generating thread, in megabytes.
+#define GENERATE_HASH_MB 64
+
+// Samples read, and fitted as one batch, at a time.
+#define CHUNK_SAMPLES (1 << 16)
+
+// Every VALIDATION_EVERY-th sample is held out of the fit to measure it.
+#define VALIDATION_EVERY 10
+
+// Added to the sum of squared inputs of each weight before dividing its
+// gradient by it, so weights seen in few positions move slowly.
+#define SMOOTHING 8.0
+
+// Weights that make up each position's score. A step of rate 1 moves each of
+// them by its share of the error, so together they would correct it once.
+#define TERMS (PATTERN_INSTANCES + EVAL_FEATURES)
+
+/*
+ * Self-play games shared out between threads. Each game's random moves come
+ * from its own seed, so a game plays out the same whichever thread runs it.
+ */
+struct Generator {
+    ofstream out;
+    mutex lock;
+    atomic<int> nextGame;
+    int games;
+    int depth;
+    unsigned seed;
+    long written;
+
+    // Plays one game, labelling every position on the way.
+    void playGame(Player &player, int game, vector<TrainingSample> &samples) {
+        minstd_rand random(seed * 1000003u + game);
+        EndgameSolver solver(&player.tt);
+        Board board;
+        Side side = BLACK;
+        samples.clear();
+        for (int ply = 0; !board.isDone(); ply++) {
+            MoveList moves = board.getMoves(side);
+            if (moves.empty()) {
+                side = opponentOf(side);
+                continue;
+            }
+
+            TrainingSample s;
+            s.player = board.getStones(side);
+            s.opponent = board.getStones(opponentOf(side));
+            int empties = 64 - __builtin_popcountll(s.player | s.opponent);
+            int best = -1;
+            player.startClock(&board, -1);
+            player.tt.newSearch();
+            if (empties <= EXACT_EMPTIES) {
+                s.score = EVAL_SCALE * solver.solve(s.player, s.opponent,
+                                                    -64, 64, best);
+                s.exact = 1;
+            } else {
+                // A search that runs into the end of the game scores beyond
+                // any evaluation; such labels are cut back to EVAL_MAX
+                s.score = player.getSearchScore(&board, side, depth);
+                if (s.score > EVAL_MAX) s.score = EVAL_MAX;
+                if (s.score < -EVAL_MAX) s.score = -EVAL_MAX;
+                s.exact = 0;
+                TTEntry entry;
+                if (player.tt.probe(board.getHash(side), entry)) {
+                    best = entry.move;
+                }
+            }
+            samples.push_back(s);
+
+            Move move(best);
+            if (best < 0 || ply < RANDOM_PLIES ||
+                (int) (random() % 100) < RANDOM_MOVE_PERCENT) {
+                move = moves[random() % moves.size()];
+            }
+            board.doMove(&move, side);
+            side = opponentOf(side);
+        }
+    }
+
+    // Plays games until there are none left, appending each one's samples
+    // to the file as it finishes.
+    void run() {
+        Player player(BLACK, nullptr, GENERATE_HASH_MB, 1);
+        vector<TrainingSample> samples;
+        for (int game = nextGame++; game < games; game = nextGame++) {
+            playGame(player, game, samples);
+
+            lock_guard<mutex> guard(lock);
+            out.write((const char *) samples.data(),
+                      samples.size() * sizeof(TrainingSample));
+            written += samples.size();
+            cerr << "Game " << game + 1 << " of " << games << ": "
+                 << written << " positions" << endl;
+        }
+    }
+};
+
+static int generate(const char *path, int games, int depth, int threads,
+                    unsigned seed) {
+    Generator gen;
+    if (!openSamples(path, gen.out)) {
+        cerr << "Could not open " << path << " for writing" << endl;
+        return 1;
+    }
+    gen.nextGame = 0;
+    gen.games = games;
+    gen.depth = depth;
+    gen.seed = seed;
+    gen.written = 0;
+
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(thread(&Generator::run, &gen));
+    }
+    for (thread &worker : workers) worker.join();
+
+    gen.out.flush();
+    if (!gen.out) {
+        cerr << "Could not write " << path << endl;
+        return 1;
+    }
+    cout << "Wrote " << gen.written << " positions to " << path << endl;
+    return 0;
+}
+
+/*
+ * Sums over one thread's share of a batch: the gradient of the squared error
+ * and the sum of squared inputs for every weight, and the squared error of
+ * the training and held-out samples. A batch only touches a small part of
+ * the weights, so those are listed, and summing or stepping gradients only
+ * visits them.
+ */
+struct Gradient {
+    vector<double> grad;
+    vector<double> hess;
+    vector<int> touched;
+    double loss, validationLoss;
+    long samples, validationSamples;
+
+    void reset(size_t weights) {
+        grad.assign(weights, 0);
+        hess.assign(weights, 0);
+        touched.clear();
+        loss = validationLoss = 0;
+        samples = validationSamples = 0;
+    }
+
+    void add(int i, double g, double h) {
+        if (hess[i] == 0) touched.push_back(i);
+        grad[i] += g;
+        hess[i] += h;
+    }
+
+    // Moves the batch sums of "other" into this one, leaving it cleared
+    // (its errors stay, to be summed at the end of the pass).
+    void take(Gradient &other) {
+        for (int i : other.touched) {
+            add(i, other.grad[i], other.hess[i]);
+            other.grad[i] = other.hess[i] = 0;
+        }
+        other.touched.clear();
+    }
+};
+
+/*
+ * Linear model with the same terms as PatternEval, in floating point: per
+ * phase, every pattern weight and then the feature weights. Weights of
+ * pattern indices that are mirror images of each other are one weight.
+ */
+struct Model {
+    PatternEval eval;
+    int phaseSize;
+    int typeOffset[PATTERN_TYPES];
+    vector<int> canonical;
+    vector<float> weights;
+
+    Model() {
+        phaseSize = eval.table(1, 0) - eval.table(0, 0);
+        for (int t = 0; t < PATTERN_TYPES; t++) {
+            typeOffset[t] = eval.table(0, t) - eval.table(0, 0);
+        }
+        canonical.resize(phaseSize);
+        for (int t = 0; t < PATTERN_TYPES; t++) {
+            int entries = 1;
+            for (int k = 0; k < PatternEval::typeSize(t); k++) entries *= 3;
+            for (int i = 0; i < entries; i++) {
+                canonical[typeOffset[t] + i] =
+                    typeOffset[t] + PatternEval::canonicalIndex(t, i);
+            }
+        }
+        weights.resize(EVAL_PHASES * (phaseSize + EVAL_FEATURES));
+    }
+
+    int featureBase(int phase) {
+        return EVAL_PHASES * phaseSize + phase * EVAL_FEATURES;
+    }
+
+    void fromEval() {
+        for (int p = 0; p < EVAL_PHASES; p++) {
+            const int16_t *w = eval.table(p, 0);
+            for (int i = 0; i < phaseSize; i++) {
+                weights[p * phaseSize + i] = w[i];
+            }
+            for (int f = 0; f < EVAL_FEATURES; f++) {
+                weights[featureBase(p) + f] = eval.features(p)[f];
+            }
+        }
+    }
+
+    // Rounds the weights into the evaluation, clamped to what an int16_t
+    // holds.
+    void toEval() {
+        for (int p = 0; p < EVAL_PHASES; p++) {
+            int16_t *w = eval.table(p, 0);
+            for (int i = 0; i < phaseSize; i++) {
+                w[i] = clamp16(weights[p * phaseSize + canonical[i]]);
+            }
+            for (int f = 0; f < EVAL_FEATURES; f++) {
+                eval.features(p)[f] = clamp16(weights[featureBase(p) + f]);
+            }
+        }
+        eval.symmetrize();
+    }
+
+    static int16_t clamp16(float w) {
+        long rounded = lround(w);
+        if (rounded > INT16_MAX) return INT16_MAX;
+        if (rounded < INT16_MIN) return INT16_MIN;
+        return rounded;
+    }
+
+    // Adds one sample's error to the gradient, or only to the held-out
+    // error.
+    void addSample(const TrainingSample &s, bool validation, Gradient &g) {
+        int phase = PatternEval::getPhase(
+            __builtin_popcountll(s.player | s.opponent));
+        int base = phase * phaseSize;
+        int indices[PATTERN_INSTANCES];
+        int features[EVAL_FEATURES];
+        PatternEval::getIndices(s.player, s.opponent, indices);
+        PatternEval::getFeatures(s.player, s.opponent, features);
+
+        int params[PATTERN_INSTANCES];
+        double predicted = 0;
+        for (int i = 0; i < PATTERN_INSTANCES; i++) {
+            int type = PatternEval::instance(i).type;
+            params[i] = base + canonical[typeOffset[type] + indices[i]];
+            predicted += weights[params[i]];
+        }
+        int fb = featureBase(phase);
+        for (int f = 0; f < EVAL_FEATURES; f++) {
+            predicted += weights[fb + f] * features[f];
+        }
+
+        double error = s.score - predicted;
+        if (validation) {
+            g.validationLoss += error * error;
+            g.validationSamples++;
+            return;
+        }
+        g.loss += error * error;
+        g.samples++;
+        for (int i = 0; i < PATTERN_INSTANCES; i++) {
+            g.add(params[i], error, 1);
+        }
+        for (int f = 0; f < EVAL_FEATURES; f++) {
+            if (features[f] == 0) continue;
+            g.add(fb + f, error * features[f], features[f] * features[f]);
+        }
+    }
+
+    // Steps every weight the batch touched down its gradient, scaled by its
+    // sum of squared inputs, and clears the gradient.
+    void step(Gradient &g, double rate) {
+        for (int i : g.touched) {
+            weights[i] += rate / TERMS * g.grad[i] / (g.hess[i] + SMOOTHING);
+            g.grad[i] = g.hess[i] = 0;
+        }
+        g.touched.clear();
+    }
+};
+
+/*
+ * One pass of the fit over a training file. The file is read a chunk at a
+ * time, and the same worker threads, started once for the pass, each add
+ * their share of every chunk to their own gradient.
+ */
+struct FitPass {
+    Model *model;
+    int threads;
+    vector<Gradient> gradients;
+    vector<TrainingSample> chunk;
+    long n;             // samples in the chunk
+    long offset;        // position of its first sample in the file
+
+    mutex lock;
+    condition_variable ready;
+    condition_variable done;
+    long round;
+    int busy;
+    bool finished;
+
+    FitPass(Model *model, int threads)
+        : model(model), threads(threads), gradients(threads),
+          chunk(CHUNK_SAMPLES), n(0), offset(0), round(0), busy(0),
+          finished(false) {
+        for (Gradient &g : gradients) g.reset(model->weights.size());
+    }
+
+    // Worker t: adds its share of each chunk to its gradient, until the
+    // pass is finished.
+    void run(int t) {
+        long seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            ready.wait(guard, [&]() { return finished || round != seen; });
+            if (round == seen) return;
+            seen = round;
+            guard.unlock();
+            for (long i = t; i < n; i += threads) {
+                bool validation = (offset + i) % VALIDATION_EVERY == 0;
+                model->addSample(chunk[i], validation, gradients[t]);
+            }
+            guard.lock();
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+    // Has the workers go through the chunk, then sums their gradients into
+    // the first.
+    void addChunk() {
+        unique_lock<mutex> guard(lock);
+        busy = threads;
+        round++;
+        ready.notify_all();
+        done.wait(guard, [&]() { return busy == 0; });
+        guard.unlock();
+        for (int t = 1; t < threads; t++) gradients[0].take(gradients[t]);
+    }
+
+    void finish() {
+        lock_guard<mutex> guard(lock);
+        finished = true;
+        ready.notify_all();
+    }
+};
+
+/*
+ * Fits the model to a training file by gradient descent, reading the file
+ * in chunks of CHUNK_SAMPLES so it never has to fit in memory: each chunk is
+ * split between the threads, their gradients are summed, and the weights
+ * take one step. Writes the weights after every pass over the file.
+ */
+static int fit(const char *samplesPath, const char *weightsPath, int epochs,
+               int threads, double rate) {
+    Model model;
+    if (model.eval.load(weightsPath)) {
+        cerr << "Starting from " << weightsPath << endl;
+    }
+    model.fromEval();
+
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        ifstream in;
+        if (!openSamples(samplesPath, in)) {
+            cerr << "Could not read " << samplesPath << endl;
+            return 1;
+        }
+
+        FitPass pass(&model, threads);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.push_back(thread(&FitPass::run, &pass, t));
+        }
+        while (in) {
+            in.read((char *) pass.chunk.data(),
+                    CHUNK_SAMPLES * sizeof(TrainingSample));
+            pass.n = in.gcount() / sizeof(TrainingSample);
+            if (pass.n == 0) break;
+
+            pass.addChunk();
+            pass.offset += pass.n;
+            model.step(pass.gradients[0], rate);
+        }
+        pass.finish();
+        for (thread &worker : workers) worker.join();
+
+        double loss = 0, validationLoss = 0;
+        long samples = 0, validationSamples = 0;
+        for (Gradient &g : pass.gradients) {
+            loss += g.loss;
+            samples += g.samples;
+            validationLoss += g.validationLoss;
+            validationSamples += g.validationSamples;
+        }
+        if (samples == 0) {
+            cerr << "No positions in " << samplesPath << endl;
+            return 1;
+        }
+
+        model.toEval();
+        if (!model.eval.save(weightsPath)) {
+            cerr << "Could not write " << weightsPath << endl;
+            return 1;
+        }
+        cout << "Epoch " << epoch + 1 << " of " << epochs << ": error "
+             << sqrt(loss / samples) / EVAL_SCALE << " discs on " << samples
+             << " positions, " << sqrt(validationLoss /
+                                       max(validationSamples, 1L)) / EVAL_SCALE
+             << " on " << validationSamples << " held out" << endl;
+    }
+    return 0;
+}
+
+/*
+ * Trains the evaluation weights offline, in two steps: "generate" plays
+ * self-play games on several threads and appends every position to a
+ * training file, labelled by a deeper full-width search or, near the end, by
+ * the exact endgame solver; "fit" fits the pattern and feature weights to a
+ * training file and writes a weights file, which the player loads at
+ * startup from othello.weights. Generating with the new weights and fitting
+ * again improves both the games and the labels.
+ *
+ * Usage: evaltrain generate <training file> [games] [depth] [threads] [seed]
+ *        evaltrain fit <training file> <weights file> [epochs] [threads]
+ *                  [rate]
+ */
+int main(int argc, char *argv[]) {
+    int cores = max(1u, thread::hardware_concurrency());
+    if (argc >= 3 && !strcmp(argv[1], "generate")) {
+        int games = (argc > 3) ? atoi(argv[3]) : 100;
+        int depth = (argc > 4) ? atoi(argv[4]) : 8;
+        int threads = (argc > 5) ? atoi(argv[5]) : cores;
+        unsigned seed = (argc > 6) ? atoi(argv[6]) : 1;
+        return generate(argv[2], games, depth, max(threads, 1), seed);
+    }
+    if (argc >= 4 && !strcmp(argv[1], "fit")) {
+        int epochs = (argc > 4) ? atoi(argv[4]) : 20;
+        int threads = (argc > 5) ? atoi(argv[5]) : cores;
+        double rate = (argc > 6) ? atof(argv[6]) : 2;
+        return fit(argv[2], argv[3], epochs, max(threads, 1), rate);
+    }
+
+    cerr << "Usage: " << argv[0]
+         << " generate <training file> [games] [depth] [threads] [seed]"
+         << endl
+         << "       " << argv[0]
+         << " fit <training file> <weights file> [epochs] [threads] [rate]"
+         << endl;
+    return 1;
+}
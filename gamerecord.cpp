@@ -0,0 +1,302 @@
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gamerecord.hpp"
+
+// Archive file format: the magic bytes and a version, then the games one
+// after another, appended as they finish. Each game is
+//
+//     uint8   flags (GameFlag)
+//     uint8   number of moves
+//     int8    result: black's final discs minus white's
+//     uint8   length of black's name
+//     uint8   length of white's name
+//     uint32  black's thinking time in ms
+//     uint32  white's thinking time in ms
+//     black's name, then white's name
+//     the black and white bitboards of the start, if GAME_START_GIVEN
+//     one byte per move: its square index
+//
+// with numbers little-endian and nothing aligned, so a game from the usual
+// start by two short-named players takes about 80 bytes.
+#define GAMES_MAGIC "OTHG"
+#define GAMES_VERSION 1
+#define GAMES_HEADER_BYTES 8
+#define RECORD_HEADER_BYTES 13
+
+// Longest player name kept.
+#define MAX_NAME 255
+
+/*
+ * Make an empty game from the usual start.
+ */
+GameRecord::GameRecord() {
+    flags = 0;
+    result = 0;
+    blackMs = 0;
+    whiteMs = 0;
+    startBlack = 0;
+    startWhite = 0;
+    moveCount = 0;
+}
+
+/*
+ * The position the game starts from and the side that moves first.
+ */
+void GameRecord::getStart(Board &board, Side &side) const {
+    board = Board();
+    side = BLACK;
+    if (flags & GAME_START_GIVEN) {
+        char data[64];
+        for (int i = 0; i < 64; i++) {
+            data[i] = (startBlack >> i & 1) ? 'b'
+                    : (startWhite >> i & 1) ? 'w' : '-';
+        }
+        board.setBoard(data);
+        if (flags & GAME_WHITE_FIRST) side = WHITE;
+    }
+}
+
+/*
+ * Plays the game through from its start, putting the position before each
+ * move and the side making it in positions[] and sides[], and the final
+ * position (with the side that would move next) after them; both need room
+ * for moveCount + 1 entries. Sides without a move pass. Returns the number
+ * of moves played, which is less than moveCount if one was illegal.
+ */
+int GameRecord::replay(Board *positions, Side *sides) const {
+    Board board;
+    Side side;
+    getStart(board, side);
+
+    int i = 0;
+    for (; i <= moveCount; i++) {
+        if (!board.hasMoves(side) && board.hasMoves(opponentOf(side))) {
+            side = opponentOf(side);
+        }
+        positions[i] = board;
+        sides[i] = side;
+        if (i == moveCount) break;
+
+        Move move(moves[i]);
+        if (!board.checkMove(&move, side)) break;
+        board.doMove(&move, side);
+        side = opponentOf(side);
+    }
+    return i;
+}
+
+/*
+ * Make a writer with no file open.
+ */
+GameWriter::GameWriter() {
+    file = nullptr;
+}
+
+GameWriter::~GameWriter() {
+    close();
+}
+
+/*
+ * Opens an archive for appending, writing the header if it is new. Returns
+ * false if it cannot be written or holds something else.
+ */
+bool GameWriter::open(const char *path) {
+    close();
+
+    FILE *in = fopen(path, "rb");
+    if (in) {
+        char header[GAMES_HEADER_BYTES];
+        size_t n = fread(header, 1, sizeof(header), in);
+        fclose(in);
+        if (n > 0) {
+            uint32_t version;
+            memcpy(&version, header + 4, sizeof(version));
+            if (n != sizeof(header) || memcmp(header, GAMES_MAGIC, 4) != 0 ||
+                version != GAMES_VERSION) {
+                return false;
+            }
+            file = fopen(path, "ab");
+            return file != nullptr;
+        }
+    }
+
+    file = fopen(path, "wb");
+    if (!file) return false;
+    uint32_t version = GAMES_VERSION;
+    fwrite(GAMES_MAGIC, 1, 4, file);
+    fwrite(&version, sizeof(version), 1, file);
+    return fflush(file) == 0;
+}
+
+void GameWriter::close() {
+    if (file) fclose(file);
+    file = nullptr;
+}
+
+/*
+ * Appends one game; it is on disk (as far as the OS is concerned) when this
+ * returns.
+ */
+bool GameWriter::write(const GameRecord &game) {
+    if (!file || game.moveCount < 0 || game.moveCount > GAME_MAX_MOVES) {
+        return false;
+    }
+
+    uint8_t blackLength = game.black.size() > MAX_NAME ? MAX_NAME
+                                                       : game.black.size();
+    uint8_t whiteLength = game.white.size() > MAX_NAME ? MAX_NAME
+                                                       : game.white.size();
+    uint8_t header[RECORD_HEADER_BYTES];
+    header[0] = game.flags;
+    header[1] = game.moveCount;
+    header[2] = (uint8_t) game.result;
+    header[3] = blackLength;
+    header[4] = whiteLength;
+    memcpy(header + 5, &game.blackMs, 4);
+    memcpy(header + 9, &game.whiteMs, 4);
+
+    string record((const char *) header, sizeof(header));
+    record.append(game.black, 0, blackLength);
+    record.append(game.white, 0, whiteLength);
+    if (game.flags & GAME_START_GIVEN) {
+        record.append((const char *) &game.startBlack, 8);
+        record.append((const char *) &game.startWhite, 8);
+    }
+    record.append((const char *) game.moves, game.moveCount);
+
+    return fwrite(record.data(), 1, record.size(), file) == record.size() &&
+           fflush(file) == 0;
+}
+
+/*
+ * Make an archive with no file mapped.
+ */
+GameArchive::GameArchive() {
+    map = nullptr;
+    mapSize = 0;
+    data = nullptr;
+}
+
+GameArchive::~GameArchive() {
+    close();
+}
+
+/*
+ * Maps an archive written by GameWriter. Returns false if the file is
+ * missing or not an archive.
+ */
+bool GameArchive::open(const char *path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < GAMES_HEADER_BYTES) {
+        ::close(fd);
+        return false;
+    }
+
+    void *file = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (file == MAP_FAILED) return false;
+
+    uint32_t version;
+    memcpy(&version, (const char *) file + 4, sizeof(version));
+    if (memcmp(file, GAMES_MAGIC, 4) != 0 || version != GAMES_VERSION) {
+        munmap(file, st.st_size);
+        return false;
+    }
+
+    // Games are read front to back; let the OS read ahead.
+    madvise(file, st.st_size, MADV_SEQUENTIAL);
+    map = file;
+    mapSize = st.st_size;
+    data = (const uint8_t *) file;
+    return true;
+}
+
+/*
+ * Unmaps the archive, if any.
+ */
+void GameArchive::close() {
+    if (map) munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    data = nullptr;
+}
+
+bool GameArchive::isOpen() {
+    return map != nullptr;
+}
+
+// Offset of the first game
+size_t GameArchive::begin() {
+    return GAMES_HEADER_BYTES;
+}
+
+// Offset just past the last game
+size_t GameArchive::end() {
+    return mapSize;
+}
+
+/*
+ * Reads the game at "offset" and moves the offset on to the next one.
+ * Returns false, leaving the offset alone, at the end of the archive or at
+ * a game that is cut short or makes no sense.
+ */
+bool GameArchive::read(size_t &offset, GameRecord &game) {
+    if (!data || offset + RECORD_HEADER_BYTES > mapSize) return false;
+
+    const uint8_t *p = data + offset;
+    uint8_t flags = p[0];
+    int moveCount = p[1];
+    int blackLength = p[3];
+    int whiteLength = p[4];
+    size_t size = RECORD_HEADER_BYTES + blackLength + whiteLength +
+                  ((flags & GAME_START_GIVEN) ? 16 : 0) + moveCount;
+    if (moveCount > GAME_MAX_MOVES || offset + size > mapSize) return false;
+
+    game.flags = flags;
+    game.moveCount = moveCount;
+    game.result = (int8_t) p[2];
+    memcpy(&game.blackMs, p + 5, 4);
+    memcpy(&game.whiteMs, p + 9, 4);
+    p += RECORD_HEADER_BYTES;
+    game.black.assign((const char *) p, blackLength);
+    p += blackLength;
+    game.white.assign((const char *) p, whiteLength);
+    p += whiteLength;
+    game.startBlack = game.startWhite = 0;
+    if (flags & GAME_START_GIVEN) {
+        memcpy(&game.startBlack, p, 8);
+        memcpy(&game.startWhite, p + 8, 8);
+        p += 16;
+    }
+    memcpy(game.moves, p, moveCount);
+
+    offset += size;
+    return true;
+}
+
+/*
+ * Finds the offset of every game, stepping over them without reading them.
+ * Returns false if the archive ends in a game that is cut short (the
+ * offsets of the games before it are still there).
+ */
+bool GameArchive::index(vector<size_t> &offsets) {
+    offsets.clear();
+    size_t offset = begin();
+    while (offset + RECORD_HEADER_BYTES <= mapSize) {
+        const uint8_t *p = data + offset;
+        size_t size = RECORD_HEADER_BYTES + p[3] + p[4] +
+                      ((p[0] & GAME_START_GIVEN) ? 16 : 0) + p[1];
+        if (p[1] > GAME_MAX_MOVES || offset + size > mapSize) return false;
+        offsets.push_back(offset);
+        offset += size;
+    }
+    return offset == mapSize;
+}
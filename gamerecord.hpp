@@ -0,0 +1,93 @@
+#ifndef __GAMERECORD_H__
+#define __GAMERECORD_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "common.hpp"
+#include "board.hpp"
+using namespace std;
+
+// Most moves a game can have (passes are not stored).
+#define GAME_MAX_MOVES 60
+
+// Flags of a game record
+enum GameFlag {
+    GAME_START_GIVEN = 1,     // starts from its own position, not the usual
+    GAME_WHITE_FIRST = 2,     // white moves first from that position
+    GAME_BLACK_FORFEIT = 4,   // black lost on time, a crash or a bad move
+    GAME_WHITE_FORFEIT = 8
+};
+
+/*
+ * One finished game: who played it, how it ended, how long each side
+ * thought, and its moves as square indices (x + 8*y). Passes are not
+ * recorded; replaying the moves puts them back where the side to move had
+ * no move.
+ */
+struct GameRecord {
+    string black;
+    string white;
+    uint8_t flags;
+    int8_t result;          // black's final discs minus white's
+    uint32_t blackMs;
+    uint32_t whiteMs;
+    uint64_t startBlack;    // the start position, if GAME_START_GIVEN
+    uint64_t startWhite;
+    int moveCount;
+    uint8_t moves[GAME_MAX_MOVES];
+
+    GameRecord();
+
+    void getStart(Board &board, Side &side) const;
+    int replay(Board *positions, Side *sides) const;
+};
+
+/*
+ * Appends games to an archive file. Not thread-safe: threads that share a
+ * writer must take turns.
+ */
+class GameWriter {
+
+private:
+    FILE *file;
+
+public:
+    GameWriter();
+    ~GameWriter();
+
+    bool open(const char *path);
+    void close();
+    bool write(const GameRecord &game);
+};
+
+/*
+ * A game archive read straight from a memory-mapped file. Games are read
+ * one after another from an offset, so a pass over millions of them only
+ * ever touches each byte once; index() finds where every game starts, to
+ * split an archive between threads.
+ */
+class GameArchive {
+
+private:
+    void *map;
+    size_t mapSize;
+    const uint8_t *data;
+
+public:
+    GameArchive();
+    ~GameArchive();
+
+    bool open(const char *path);
+    void close();
+    bool isOpen();
+
+    size_t begin();
+    size_t end();
+    bool read(size_t &offset, GameRecord &game);
+    bool index(vector<size_t> &offsets);
+};
+
+#endif
@@ -0,0 +1,613 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include "common.hpp"
+#include "board.hpp"
+#include "player.hpp"
+#include "gamerecord.hpp"
+using namespace std;
+
+// Table size for players linked into the runner; many games run at once.
+#define MATCH_HASH_MB 16
+
+// How long a player binary may take to say "Init done", and how far past
+// its clock it may answer a move before it is killed.
+#define INIT_TIMEOUT_MS 30000
+#define ANSWER_MARGIN_MS 1000
+
+// SPRT error rates (both kinds).
+#define SPRT_ALPHA 0.05
+#define SPRT_BETA 0.05
+
+/*
+ * How to run one engine: either a Player linked into the runner (path
+ * empty), with its own settings, or a player binary that speaks the
+ * wrapper's stdin/stdout protocol.
+ */
+struct EngineSpec {
+    string name;
+    string path;
+    int depth;
+    int threads;
+    int hashMB;
+    string weights;
+    string book;
+    int selectivity;
+    string probcut;
+    const Player *tables;   // weights, book and ProbCut of a linked player
+
+    EngineSpec() : depth(-1), threads(1), hashMB(MATCH_HASH_MB),
+                   selectivity(-1), tables(nullptr) {}
+};
+
+/*
+ * Parses "self[:key=value,...]" (keys depth, threads, hash, weights, book,
+ * selectivity and probcut; book=none turns the book off) or the path of a
+ * player binary.
+ */
+static bool parseEngine(const string &text, EngineSpec &spec) {
+    spec.name = text;
+    if (text.compare(0, 4, "self") != 0) {
+        spec.path = text;
+        return true;
+    }
+    if (text.size() == 4) return true;
+    if (text[4] != ':') return false;
+
+    stringstream options(text.substr(5));
+    string option;
+    while (getline(options, option, ',')) {
+        size_t eq = option.find('=');
+        if (eq == string::npos) return false;
+        string key = option.substr(0, eq);
+        string value = option.substr(eq + 1);
+        if (key == "depth") spec.depth = atoi(value.c_str());
+        else if (key == "threads") spec.threads = atoi(value.c_str());
+        else if (key == "hash") spec.hashMB = atoi(value.c_str());
+        else if (key == "weights") spec.weights = value;
+        else if (key == "book") spec.book = value;
+        else if (key == "selectivity") spec.selectivity = atoi(value.c_str());
+        else if (key == "probcut") spec.probcut = value;
+        else return false;
+    }
+    return true;
+}
+
+/*
+ * Loads the weights, book and ProbCut parameters a linked engine asks for
+ * into a player whose tables all its games then share. Returns nullptr if a
+ * file cannot be used.
+ */
+static Player *loadTables(const EngineSpec &spec) {
+    Player *tables = new Player(BLACK, nullptr, 1, 1);
+    const char *failed = nullptr;
+    if (!spec.weights.empty() && !tables->loadWeights(spec.weights.c_str())) {
+        failed = spec.weights.c_str();
+    }
+    if (spec.book == "none") {
+        tables->book = make_shared<OpeningBook>();
+    } else if (!spec.book.empty() && !tables->loadBook(spec.book.c_str())) {
+        failed = spec.book.c_str();
+    }
+    if (!spec.probcut.empty() && !tables->loadProbCut(spec.probcut.c_str())) {
+        failed = spec.probcut.c_str();
+    }
+    if (failed) {
+        cerr << "Could not load " << failed << " for " << spec.name << endl;
+        delete tables;
+        return nullptr;
+    }
+    return tables;
+}
+
+/*
+ * One side of a game. play() gets the opponent's last move (nullptr for a
+ * pass or at the start) and returns this side's move, or nullptr to pass.
+ * An engine that crashes or stops answering sets "failed", and also
+ * "timedOut" if it was given up on for answering too slowly.
+ */
+class Engine {
+public:
+    bool failed;
+    bool timedOut;
+
+    Engine() : failed(false), timedOut(false) {}
+    virtual ~Engine() {}
+    virtual Move *play(Move *opponentsMove, int msLeft) = 0;
+};
+
+class LinkedEngine : public Engine {
+private:
+    Player *player;
+
+public:
+    LinkedEngine(const EngineSpec &spec, Side side, const char *opening) {
+        player = new Player(side, spec.tables, spec.hashMB, spec.threads);
+        if (spec.depth > 0) player->maxDepth = spec.depth;
+        if (spec.selectivity >= 0) player->selectivity = spec.selectivity;
+
+        if (opening) {
+            Board board;
+            board.setBoard(opening);
+            player->setBoard(&board);
+        }
+    }
+
+    ~LinkedEngine() {
+        delete player;
+    }
+
+    Move *play(Move *opponentsMove, int msLeft) {
+        return player->doMove(opponentsMove, msLeft);
+    }
+};
+
+/*
+ * A player binary run as a child process, exactly as the Java framework runs
+ * it: the side as its argument, "Init done" when ready, then one
+ * "x y msLeft" line in and one "x y" line out per move. A binary that does
+ * not answer in time is killed, so it cannot hold up the match.
+ */
+class ProcessEngine : public Engine {
+private:
+    pid_t pid;
+    int in;
+    FILE *out;
+    string pending;     // read from the binary but not yet used
+
+    // Reads one line of output, waiting at most timeoutMs (forever if
+    // negative). A binary that runs out of time is killed.
+    bool readLine(string &line, long timeoutMs) {
+        chrono::steady_clock::time_point deadline =
+            chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+        size_t end;
+        while ((end = pending.find('\n')) == string::npos) {
+            int wait = -1;
+            if (timeoutMs >= 0) {
+                wait = (int) chrono::duration_cast<chrono::milliseconds>(
+                    deadline - chrono::steady_clock::now()).count();
+                if (wait < 0) wait = 0;
+            }
+            struct pollfd fd = { in, POLLIN, 0 };
+            int ready = poll(&fd, 1, wait);
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready == 0) {
+                kill(pid, SIGKILL);
+                timedOut = true;
+                return false;
+            }
+            char buffer[256];
+            ssize_t n = (ready < 0) ? -1 : read(in, buffer, sizeof(buffer));
+            if (n <= 0) return false;
+            pending.append(buffer, n);
+        }
+        line = pending.substr(0, end);
+        pending.erase(0, end + 1);
+        return true;
+    }
+
+public:
+    ProcessEngine(const EngineSpec &spec, Side side) {
+        pid = -1;
+        in = -1;
+        out = nullptr;
+
+        int toChild[2], fromChild[2];
+        // Close-on-exec, so engines started by other games' threads do not
+        // hold on to these pipes
+        if (pipe2(toChild, O_CLOEXEC) != 0 || pipe2(fromChild, O_CLOEXEC) != 0) {
+            failed = true;
+            return;
+        }
+        pid = fork();
+        if (pid == 0) {
+            dup2(toChild[0], 0);
+            dup2(fromChild[1], 1);
+            int devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0) dup2(devnull, 2);
+            close(toChild[1]);
+            close(fromChild[0]);
+            execl(spec.path.c_str(), spec.path.c_str(),
+                  side == BLACK ? "Black" : "White", (char *) nullptr);
+            _exit(127);
+        }
+        close(toChild[0]);
+        close(fromChild[1]);
+        out = fdopen(toChild[1], "w");
+        in = fromChild[0];
+
+        string line;
+        if (pid < 0 || !readLine(line, INIT_TIMEOUT_MS) ||
+            line.compare(0, 9, "Init done") != 0) {
+            failed = true;
+        }
+    }
+
+    ~ProcessEngine() {
+        if (out) fclose(out);
+        if (in >= 0) close(in);
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    Move *play(Move *opponentsMove, int msLeft) {
+        if (failed) return nullptr;
+
+        fprintf(out, "%d %d %d\n", opponentsMove ? opponentsMove->getX() : -1,
+                opponentsMove ? opponentsMove->getY() : -1, msLeft);
+        fflush(out);
+
+        string line;
+        int x, y;
+        if (!readLine(line, msLeft < 0 ? -1 : msLeft + ANSWER_MARGIN_MS) ||
+            sscanf(line.c_str(), "%d %d", &x, &y) != 2) {
+            failed = true;
+            return nullptr;
+        }
+        if (x < 0 || y < 0) return nullptr;
+        return new Move(x, y);
+    }
+};
+
+static Engine *makeEngine(const EngineSpec &spec, Side side,
+                          const char *opening) {
+    if (spec.path.empty()) return new LinkedEngine(spec, side, opening);
+    return new ProcessEngine(spec, side);
+}
+
+/*
+ * A starting position: 64 characters as for Board::setBoard() and the side
+ * to move. A null "data" is the standard start.
+ */
+struct Opening {
+    string data;
+    Side side;
+};
+
+/*
+ * Reads openings, one per line: 64 characters ('b', 'w', anything else for
+ * empty), optionally followed by the side to move ('b' or 'w', black by
+ * default). Blank lines and lines starting with '#' are skipped. An opening
+ * needs at least 4 discs, so that its games fit in a game record.
+ */
+static bool readOpenings(const char *path, vector<Opening> &openings) {
+    ifstream file(path);
+    if (!file) return false;
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        stringstream fields(line);
+        Opening opening;
+        string side = "b";
+        fields >> opening.data >> side;
+        if (opening.data.size() != 64) return false;
+        int discs = 0;
+        for (char c : opening.data) discs += (c == 'b' || c == 'w');
+        if (64 - discs > GAME_MAX_MOVES) return false;
+        opening.side = (side[0] == 'w' || side[0] == 'W') ? WHITE : BLACK;
+        openings.push_back(opening);
+    }
+    return !openings.empty();
+}
+
+/*
+ * Outcome of one game, from the first engine's point of view.
+ */
+struct GameResult {
+    int score;          // 2 win, 1 draw, 0 loss
+    int discs[2];       // final discs of the first and second engine
+    double seconds[2];  // thinking time of the first and second engine
+    const char *reason;
+    GameRecord record;  // the game itself, for the archive
+};
+
+/*
+ * Plays one game from an opening, with engine "first" playing black if
+ * firstBlack is set. A side that runs out of time, plays an illegal move or
+ * crashes loses.
+ */
+static GameResult playGame(const EngineSpec specs[2], const Opening *opening,
+                           bool firstBlack, int msPerGame) {
+    const char *data = opening ? opening->data.c_str() : nullptr;
+    Side firstSide = firstBlack ? BLACK : WHITE;
+
+    Engine *engines[2];
+    engines[firstSide] = makeEngine(specs[0], firstSide, data);
+    engines[opponentOf(firstSide)] =
+        makeEngine(specs[1], opponentOf(firstSide), data);
+
+    Board board;
+    if (data) board.setBoard(data);
+    Side toMove = opening ? opening->side : BLACK;
+
+    GameResult result;
+    result.seconds[0] = result.seconds[1] = 0;
+    result.reason = "";
+    GameRecord &record = result.record;
+    record.black = specs[firstBlack ? 0 : 1].name;
+    record.white = specs[firstBlack ? 1 : 0].name;
+    if (opening) {
+        record.flags |= GAME_START_GIVEN;
+        if (toMove == WHITE) record.flags |= GAME_WHITE_FIRST;
+        record.startBlack = board.getStones(BLACK);
+        record.startWhite = board.getStones(WHITE);
+    }
+    double used[2] = { 0, 0 };
+    long clock[2] = { msPerGame, msPerGame };
+    Side loser = BLACK;
+    bool forfeit = false;
+
+    Move *last = nullptr;
+    int passes = 0;
+    while (passes < 2) {
+        Engine *engine = engines[toMove];
+        if (engine->failed) {
+            forfeit = true;
+            loser = toMove;
+            result.reason = engine->timedOut ? "time" : "crash";
+            break;
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        Move *move = engine->play(last, msPerGame < 0 ? -1 : (int) clock[toMove]);
+        double ms = chrono::duration<double, milli>(
+            chrono::steady_clock::now() - start).count();
+        clock[toMove] -= (long) ms;
+        result.seconds[toMove == firstSide ? 0 : 1] += ms / 1000;
+        used[toMove] += ms;
+
+        bool legal = !engine->failed && board.checkMove(move, toMove);
+        if (engine->failed || !legal || (msPerGame >= 0 && clock[toMove] < 0)) {
+            forfeit = true;
+            loser = toMove;
+            result.reason = engine->timedOut ? "time"
+                          : engine->failed ? "crash"
+                          : !legal ? "illegal move" : "time";
+            delete move;
+            break;
+        }
+
+        board.doMove(move, toMove);
+        if (move) record.moves[record.moveCount++] = move->getSquare();
+        passes = move ? 0 : passes + 1;
+        delete last;
+        last = move;
+        toMove = opponentOf(toMove);
+    }
+    delete last;
+    delete engines[0];
+    delete engines[1];
+
+    result.discs[0] = board.count(firstSide);
+    result.discs[1] = board.count(opponentOf(firstSide));
+    record.result = board.count(BLACK) - board.count(WHITE);
+    record.blackMs = (uint32_t) used[BLACK];
+    record.whiteMs = (uint32_t) used[WHITE];
+    if (forfeit) {
+        record.flags |= (loser == BLACK) ? GAME_BLACK_FORFEIT
+                                         : GAME_WHITE_FORFEIT;
+    }
+    if (forfeit) {
+        result.score = (loser == firstSide) ? 0 : 2;
+    } else {
+        result.score = (result.discs[0] > result.discs[1]) ? 2
+                     : (result.discs[0] == result.discs[1]) ? 1 : 0;
+    }
+    return result;
+}
+
+/*
+ * Running totals of a match, with the Elo difference they suggest and a
+ * sequential probability ratio test between two Elo hypotheses.
+ */
+struct MatchStats {
+    int wins, draws, losses;
+    long discs[2];
+    double seconds[2];
+
+    MatchStats() : wins(0), draws(0), losses(0) {
+        discs[0] = discs[1] = 0;
+        seconds[0] = seconds[1] = 0;
+    }
+
+    int games() const { return wins + draws + losses; }
+
+    double score() const {
+        return games() ? (wins + 0.5 * draws) / games() : 0.5;
+    }
+
+    // Variance of a single game's score
+    double variance() const {
+        double s = score();
+        return games() ? (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s)
+                          + losses * s * s) / games() : 0;
+    }
+
+    static double toElo(double s) {
+        if (s <= 0) return -INFINITY;
+        if (s >= 1) return INFINITY;
+        return 400 * log10(s / (1 - s));
+    }
+
+    static double fromElo(double elo) {
+        return 1 / (1 + pow(10, -elo / 400));
+    }
+
+    // Half-width of the 95% confidence interval, in Elo (infinite while the
+    // interval still reaches a 0% or 100% score)
+    double eloMargin() const {
+        double delta = games() ? 1.96 * sqrt(variance() / games()) : 1;
+        if (score() - delta <= 0 || score() + delta >= 1) return INFINITY;
+        return (toElo(score() + delta) - toElo(score() - delta)) / 2;
+    }
+
+    // Log-likelihood ratio of elo1 against elo0 (normal approximation)
+    double llr(double elo0, double elo1) const {
+        double var = variance();
+        if (games() == 0 || var == 0) return 0;
+        double s0 = fromElo(elo0), s1 = fromElo(elo1);
+        return games() * (s1 - s0) * (2 * score() - s0 - s1) / (2 * var);
+    }
+};
+
+/*
+ * Plays a match between two engines: pairs of games from each opening with
+ * colours swapped, many at once, optionally stopping as soon as an SPRT
+ * decides between two Elo differences.
+ *
+ * Usage: match [-g games] [-c concurrency] [-t ms per game] [-o openings]
+ *              [-r game archive] [-s elo0 elo1] <engine> <engine>
+ * where an engine is "self[:depth=N,threads=N,hash=MB,weights=FILE,
+ * book=FILE|none,selectivity=N,probcut=FILE]" for a linked player, or the
+ * path of a player binary.
+ * Binaries always start from the standard position. With -r every game is
+ * also appended to a game archive (see gamerecord.hpp).
+ */
+int main(int argc, char *argv[]) {
+    int games = 100;
+    int concurrency = thread::hardware_concurrency();
+    int msPerGame = 10000;
+    const char *openingsPath = nullptr;
+    const char *recordPath = nullptr;
+    bool sprt = false;
+    double elo0 = 0, elo1 = 5;
+    vector<string> names;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-g" && i + 1 < argc) games = atoi(argv[++i]);
+        else if (arg == "-c" && i + 1 < argc) concurrency = atoi(argv[++i]);
+        else if (arg == "-t" && i + 1 < argc) msPerGame = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc) openingsPath = argv[++i];
+        else if (arg == "-r" && i + 1 < argc) recordPath = argv[++i];
+        else if (arg == "-s" && i + 2 < argc) {
+            sprt = true;
+            elo0 = atof(argv[++i]);
+            elo1 = atof(argv[++i]);
+        }
+        else names.push_back(arg);
+    }
+
+    EngineSpec specs[2];
+    if (names.size() != 2 || !parseEngine(names[0], specs[0]) ||
+        !parseEngine(names[1], specs[1])) {
+        cerr << "Usage: " << argv[0] << " [-g games] [-c concurrency]"
+             << " [-t ms per game] [-o openings] [-r game archive]"
+             << " [-s elo0 elo1]"
+             << " <engine> <engine>" << endl;
+        return 1;
+    }
+
+    vector<Opening> openings;
+    if (openingsPath && !readOpenings(openingsPath, openings)) {
+        cerr << "Could not read openings from " << openingsPath << endl;
+        return 1;
+    }
+    if (!openings.empty() &&
+        (!specs[0].path.empty() || !specs[1].path.empty())) {
+        cerr << "Player binaries can only start from the standard position"
+             << endl;
+        return 1;
+    }
+    GameWriter writer;
+    if (recordPath && !writer.open(recordPath)) {
+        cerr << "Could not open game archive " << recordPath << endl;
+        return 1;
+    }
+    if (concurrency < 1) concurrency = 1;
+
+    // Every game's linked players would announce themselves on stderr.
+    Player::quiet = true;
+    for (int e = 0; e < 2; e++) {
+        if (!specs[e].path.empty()) continue;
+        specs[e].tables = loadTables(specs[e]);
+        if (!specs[e].tables) return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    double lower = log(SPRT_BETA / (1 - SPRT_ALPHA));
+    double upper = log((1 - SPRT_BETA) / SPRT_ALPHA);
+
+    MatchStats stats;
+    mutex statsMutex;
+    atomic<int> nextGame(0);
+    atomic<bool> stop(false);
+
+    vector<thread> workers;
+    for (int w = 0; w < concurrency; w++) {
+        workers.push_back(thread([&]() {
+            while (!stop) {
+                int game = nextGame++;
+                if (game >= games) break;
+
+                const Opening *opening = openings.empty() ? nullptr
+                    : &openings[(game / 2) % openings.size()];
+                bool firstBlack = (game % 2 == 0);
+                GameResult r = playGame(specs, opening, firstBlack, msPerGame);
+
+                lock_guard<mutex> lock(statsMutex);
+                if (recordPath) writer.write(r.record);
+                if (r.score == 2) stats.wins++;
+                else if (r.score == 1) stats.draws++;
+                else stats.losses++;
+                for (int e = 0; e < 2; e++) {
+                    stats.discs[e] += r.discs[e];
+                    stats.seconds[e] += r.seconds[e];
+                }
+
+                cout << "Game " << game + 1 << ": " << specs[0].name << " ("
+                     << (firstBlack ? "black" : "white") << ") " << r.discs[0]
+                     << "-" << r.discs[1] << " " << specs[1].name;
+                if (*r.reason) cout << " (" << r.reason << ")";
+                cout << "  W/D/L " << stats.wins << "/" << stats.draws << "/"
+                     << stats.losses << endl;
+
+                double llr = stats.llr(elo0, elo1);
+                if (sprt && (llr <= lower || llr >= upper)) stop = true;
+            }
+        }));
+    }
+    for (thread &t : workers) t.join();
+
+    cout << fixed << setprecision(1);
+    cout << "Games: " << stats.games() << "  W/D/L: " << stats.wins << "/"
+         << stats.draws << "/" << stats.losses << "  score "
+         << 100 * stats.score() << "%" << endl;
+    cout << "Discs: " << specs[0].name << " " << stats.discs[0] << ", "
+         << specs[1].name << " " << stats.discs[1] << endl;
+    cout << "Time: " << specs[0].name << " " << stats.seconds[0] << " s, "
+         << specs[1].name << " " << stats.seconds[1] << " s" << endl;
+    cout << "Elo: " << showpos << MatchStats::toElo(stats.score())
+         << noshowpos << " +/- " << stats.eloMargin() << endl;
+    if (sprt) {
+        double llr = stats.llr(elo0, elo1);
+        cout << setprecision(2) << "SPRT (" << elo0 << ", " << elo1
+             << "): LLR " << llr << " (" << lower << ", " << upper << ") "
+             << (llr >= upper ? "H1 accepted" : llr <= lower ? "H0 accepted"
+                                                              : "undecided")
+             << endl;
+    }
+    delete specs[0].tables;
+    delete specs[1].tables;
+    return 0;
+}
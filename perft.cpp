@@ -0,0 +1,158 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include "common.hpp"
+#include "board.hpp"
+using namespace std;
+
+/*
+ * A test position together with the number of leaf nodes at each depth,
+ * starting from depth 1. The reference counts for the midgame positions were
+ * produced by the original square-by-square move generator.
+ */
+struct PerftPosition {
+    const char *name;
+    const char *data;
+    Side side;
+    long counts[12];
+};
+
+static const PerftPosition POSITIONS[] = {
+    { "initial",
+      "--------"
+      "--------"
+      "--------"
+      "---wb---"
+      "---bw---"
+      "--------"
+      "--------"
+      "--------", BLACK,
+      { 4, 12, 56, 244, 1396, 8200, 55092, 390216, 3005288, 24571284, 0 } },
+    { "midgame-20",
+      "-wbb----"
+      "-wb-----"
+      "-bbwwww-"
+      "-bbbbb--"
+      "--bwbb--"
+      "--www---"
+      "--b-----"
+      "--------", BLACK,
+      { 13, 156, 2000, 24170, 310393, 3869340, 0 } },
+    { "midgame-32",
+      "--------"
+      "bwwww--w"
+      "-wwwbbww"
+      "wwbwwwbw"
+      "ww-bwbbw"
+      "--bw-ww-"
+      "---wwww-"
+      "--------", BLACK,
+      { 16, 136, 2033, 17690, 250771, 2222598, 0 } },
+    { "midgame-37",
+      "----w---"
+      "---wbw-b"
+      "-wwwb-b-"
+      "-bbbbbbw"
+      "--bwb-b-"
+      "--wwbbbw"
+      "-wwwbbbb"
+      "-wwwwwww", WHITE,
+      { 10, 121, 1119, 12561, 113930, 1186576, 0 } },
+    { "endgame-44",
+      "w---b-bw"
+      "-wbbbbbw"
+      "wwwwwbb-"
+      "--bwbwbw"
+      "b--bbbb-"
+      "bwwwwbw-"
+      "bbbbbb--"
+      "-bbbbbb-", BLACK,
+      { 9, 100, 702, 7061, 41850, 374531, 1868764, 0 } },
+    { "endgame-52",
+      "wb--wwww"
+      "-bbwwww-"
+      "bbbbbbw-"
+      "bwbbwbbw"
+      "wwbwbbb-"
+      "wwwwwwbw"
+      "bbbwwbbb"
+      "bbbw--bw", BLACK,
+      { 7, 34, 157, 580, 1616, 3875, 5413, 5843, 5846, 0 } },
+};
+
+/*
+ * Counts the leaf nodes of the game tree to the given depth. A pass counts
+ * as a ply, and a finished game is a leaf no matter how much depth is left.
+ */
+static long perft(Board *b, Side side, int depth) {
+    MoveList moves = b->getMoves(side);
+    if (moves.empty()) {
+        if (!b->hasMoves(opponentOf(side))) return 1;
+        return (depth == 1) ? 1 : perft(b, opponentOf(side), depth - 1);
+    }
+
+    // Leaves one ply away can be counted without making the moves.
+    if (depth == 1) return moves.size();
+
+    long nodes = 0;
+    for (int i = 0; i < moves.size(); i++) {
+        uint64_t flipped = b->doMove(&moves[i], side);
+        nodes += perft(b, opponentOf(side), depth - 1);
+        b->undoMove(&moves[i], flipped, side);
+    }
+    return nodes;
+}
+
+/*
+ * Runs perft on every test position up to its deepest reference count, or up
+ * to the depth given on the command line, and checks each count. Returns a
+ * non-zero status if any count is wrong.
+ */
+int main(int argc, char *argv[]) {
+    int maxDepth = (argc > 1) ? atoi(argv[1]) : 12;
+    int failures = 0;
+    long totalNodes = 0;
+    double totalSeconds = 0;
+
+    for (const PerftPosition &pos : POSITIONS) {
+        Board board;
+        board.setBoard(pos.data);
+
+        for (int depth = 1; depth <= maxDepth && pos.counts[depth - 1]; depth++) {
+            auto start = chrono::steady_clock::now();
+            long nodes = perft(&board, pos.side, depth);
+            chrono::duration<double> elapsed =
+                chrono::steady_clock::now() - start;
+
+            bool ok = (nodes == pos.counts[depth - 1]);
+            if (!ok) failures++;
+            totalNodes += nodes;
+            totalSeconds += elapsed.count();
+
+            cout << setw(12) << left << pos.name << " depth " << setw(2)
+                 << right << depth << setw(12) << nodes << " "
+                 << (ok ? "ok   " : "WRONG") << fixed << setprecision(3)
+                 << setw(9) << elapsed.count() << " s";
+            if (elapsed.count() > 0) {
+                cout << setw(14) << (long) (nodes / elapsed.count())
+                     << " nodes/s";
+            }
+            if (!ok) cout << " (expected " << pos.counts[depth - 1] << ")";
+            cout << endl;
+        }
+    }
+
+    cout << "Total " << totalNodes << " nodes in " << fixed
+         << setprecision(3) << totalSeconds << " s";
+    if (totalSeconds > 0) {
+        cout << " (" << (long) (totalNodes / totalSeconds) << " nodes/s)";
+    }
+    cout << endl;
+
+    if (failures) {
+        cout << failures << " wrong counts" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,45 +1,268 @@
+#include <thread>
+#include <cstdio>
+#include <cmath>
+#include <unistd.h>
 #include "player.hpp"
+#include "endgame.hpp"
+#include "simd.hpp"
+
+// Time lost per move outside of our search; the Java wrapper only polls for
+// our reply every 100 ms.
+#define MOVE_OVERHEAD_MS 120
+
+// How often (in nodes) the search looks at the clock.
+#define CLOCK_CHECK_NODES 1024
+
+// Default size of the transposition table.
+#define DEFAULT_HASH_MB 64
+
+// Weights file loaded at startup if present; the evaluation falls back to
+// built-in weights otherwise.
+#define DEFAULT_WEIGHTS_FILE "othello.weights"
+
+// Opening book mapped at startup if present.
+#define DEFAULT_BOOK_FILE "othello.book"
+
+// Multi-ProbCut parameters loaded at startup if present; built-in ones are
+// used otherwise.
+#define DEFAULT_PROBCUT_FILE "othello.probcut"
+
+// How often (in ms) a move that hit the predicted reply checks whether the
+// search that was pondering it has finished.
+#define PONDER_POLL_MS 1
+
+// Move ordering keys. History scores stay below HISTORY_MAX, which fits in
+// HISTORY_BITS bits, so the mobility term always outweighs them.
+#define ORDER_TT (1 << 30)
+#define ORDER_KILLER (1 << 29)
+#define HISTORY_BITS 16
+#define HISTORY_MAX (1 << HISTORY_BITS)
+
+// Remaining depth from which moves are also ordered by opponent mobility.
+#define MOBILITY_ORDER_DEPTH 3
+
+// Multi-ProbCut selectivity level used unless changed.
+#define DEFAULT_SELECTIVITY 3
+
+// Depth of the midgame search run before an endgame solve, to have a move
+// ready in case the solve runs out of time.
+#define ENDGAME_PRESEARCH_DEPTH 6
+
+// Share of the usable time that the first endgame solve may take. Later
+// solves are much cheaper, as the positions are smaller and mostly hashed.
+#define ENDGAME_TIME_SHARE 3
+
+bool Player::quiet = false;
 
 /*
  * Constructor for the player; initialize everything here. The side your AI is
  * on (BLACK or WHITE) is passed in as "side". The constructor must finish
  * within 30 seconds.
  */
-Player::Player(Side side) {
+Player::Player(Side side)
+    : Player(side, nullptr, DEFAULT_HASH_MB, thread::hardware_concurrency()) {
+}
+
+/*
+ * Make a player that shares the evaluation weights, ProbCut parameters and
+ * opening book of "tables" instead of loading its own, or loads them from
+ * the default files if "tables" is null. Its transposition table takes
+ * hashMB megabytes and threadCount threads search each move.
+ */
+Player::Player(Side side, const Player *tables, int hashMB, int threadCount)
+    : tt(hashMB) {
     // Will be set to true in test_minimax.cpp.
     testingMinimax = false;
 
+    maxDepth = 8;
+    endgameEmpties = 18;
+    wldEmpties = 20;
+    selectivity = DEFAULT_SELECTIVITY;
+    timed = false;
+    stop = false;
+    ponder = false;
+    ponderDone = false;
+    cancelled = false;
+    ponderHit = false;
+    nodes = 0;
+    iterationCount = 0;
+    endgameNodes = 0;
+    endgameMs = 0;
+    endgameSolved = false;
+    statsFd = -1;
+    lastScore = 0;
+    lastSolved = false;
+
+    setThreads(threadCount);
+    if (tables)
+    {
+        eval = tables->eval;
+        probcut = tables->probcut;
+        book = tables->book;
+    }
+    else
+    {
+        eval = make_shared<PatternEval>();
+        probcut = make_shared<ProbCut>();
+        book = make_shared<OpeningBook>();
+        loadWeights(DEFAULT_WEIGHTS_FILE);
+        loadBook(DEFAULT_BOOK_FILE);
+        loadProbCut(DEFAULT_PROBCUT_FILE);
+    }
+
     /*
      * Initialization
      */
     my_side = side;
-    if (my_side == WHITE)
+    opponent_side = (my_side == WHITE) ? BLACK : WHITE;
+    if (!quiet)
     {
-        cerr << "Playing as WHITE\n";
-        opponent_side = BLACK;
-    }
-    else
-    {
-        cerr << "Playing as BLACK\n";
-        opponent_side = WHITE;
+        cerr << "Playing as " << (my_side == WHITE ? "WHITE" : "BLACK")
+             << "\n";
     }
 
-    board = new Board();
 }
 
 /*
  * Destructor for the player.
  */
 Player::~Player() {
-
+    if (ponderThread.joinable())
+    {
+        cancelled = true;
+        stop = true;
+        ponderThread.join();
+    }
 }
 
 /*
- * Set the board to a given configuration
+ * Set the board to a given configuration (the player keeps its own copy)
  */
 void Player::setBoard(Board * board)
 {
-    this->board = board;
+    this->board = *board;
+}
+
+/*
+ * Set the side the player moves for, e.g. to search positions with either
+ * side to move.
+ */
+void Player::setSide(Side side)
+{
+    my_side = side;
+    opponent_side = (side == BLACK) ? WHITE : BLACK;
+}
+
+/*
+ * Set the number of threads that search each move (at least one).
+ */
+void Player::setThreads(int n)
+{
+    threads.resize(n < 1 ? 1 : n);
+    for (unsigned int i = 0; i < threads.size(); i++)
+    {
+        threads[i].id = i;
+    }
+}
+
+/*
+ * Load evaluation weights from a file written by PatternEval::save(). Returns
+ * false, keeping the current weights, if the file cannot be used.
+ */
+bool Player::loadWeights(const char *path)
+{
+    shared_ptr<PatternEval> loaded = make_shared<PatternEval>();
+    if (!loaded->load(path))
+    {
+        return false;
+    }
+    eval = loaded;
+    if (!quiet)
+        cerr << "Loaded weights from " << path << "\n";
+    return true;
+}
+
+/*
+ * Map an opening book written by OpeningBook::write(). Returns false, leaving
+ * the player without a book, if the file cannot be used.
+ */
+bool Player::loadBook(const char *path)
+{
+    book = make_shared<OpeningBook>();
+    if (!book->open(path))
+    {
+        return false;
+    }
+    if (!quiet)
+        cerr << "Loaded " << book->getSize() << " book positions from "
+             << path << "\n";
+    return true;
+}
+
+/*
+ * Load Multi-ProbCut parameters written by probcutfit. Returns false, keeping
+ * the built-in parameters, if the file cannot be used.
+ */
+bool Player::loadProbCut(const char *path)
+{
+    shared_ptr<ProbCut> loaded = make_shared<ProbCut>();
+    if (!loaded->load(path))
+    {
+        return false;
+    }
+    probcut = loaded;
+    if (!quiet)
+        cerr << "Loaded ProbCut parameters from " << path << "\n";
+    return true;
+}
+
+/*
+ * Make an empty set of search counters.
+ */
+SearchStats::SearchStats()
+{
+    evals = 0;
+    cutoffs = 0;
+    firstMoveCutoffs = 0;
+    ttProbes = 0;
+    ttHits = 0;
+    ttCutoffs = 0;
+    probCuts = 0;
+}
+
+/*
+ * Adds another set of counters (another thread's) to these.
+ */
+void SearchStats::add(const SearchStats &s)
+{
+    evals += s.evals;
+    cutoffs += s.cutoffs;
+    firstMoveCutoffs += s.firstMoveCutoffs;
+    ttProbes += s.ttProbes;
+    ttHits += s.ttHits;
+    ttCutoffs += s.ttCutoffs;
+    probCuts += s.probCuts;
+}
+
+/*
+ * Make the search state for one thread.
+ */
+SearchThread::SearchThread()
+{
+    id = 0;
+    nodes = 0;
+
+    for (int i = 0; i < MAX_PLY; i++)
+    {
+        killers[i][0] = killers[i][1] = -1;
+    }
+    for (int s = 0; s < 2; s++)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            history[s][i] = 0;
+        }
+    }
 }
 
 /*
@@ -59,30 +282,67 @@ Move *Player::doMove(Move *opponentsMove, int msLeft) {
 
 
     // Process opponent move
-    board->doMove(opponentsMove, opponent_side);
+    board.doMove(opponentsMove, opponent_side);
+
+    // If we guessed the opponent's move, the background search has been
+    // working on our reply all along.
+    Move to_return;
+    ponderHit = stopPondering(opponentsMove, msLeft, to_return);
 
     // Get moves
-    vector<Move*> moves = board->getMoves(my_side);
+    MoveList moves = board.getMoves(my_side);
 
     // Return nullptr if no moves
-    if (moves.size() == 0)
+    if (moves.empty())
         return nullptr;
 
-    // Move * to_return = getRandomMove(moves);
-    // Move * to_return = getHeuristicMove(moves);
-    // Move * to_return = getTwoPlyMove(moves);
-    Move * to_return = getMinimax(board, moves);
+    if (ponderHit)
+    {
+        STAT(reportStats(to_return, false));
+        board.doMove(&to_return, my_side);
+        startPondering(msLeft);
+        return new Move(to_return);
+    }
+
+    startClock(&board, testingMinimax ? -1 : msLeft);
+
+    // Play straight from the opening book while it knows the position
+    if (!testingMinimax && book->isOpen())
+    {
+        int score;
+        int sq = book->getMove(board.getStones(my_side),
+                              board.getStones(opponent_side), score);
+        if (sq >= 0)
+        {
+            Move to_return(sq);
+            board.doMove(&to_return, my_side);
+            lastScore = score;
+            STAT(reportStats(to_return, true));
+            return new Move(to_return);
+        }
+    }
+
+    newSearch();
+
+    // to_return = getRandomMove(moves);
+    // to_return = getHeuristicMove(moves);
+    // to_return = getTwoPlyMove(moves);
+    to_return = getMinimax(&board, moves);
 
-    // cerr << "Making move: " << to_return->getX() << " " << to_return->getY() << endl;
+    // cerr << "Making move: " << to_return.getX() << " " << to_return.getY() << endl;
+
+    STAT(reportStats(to_return, false));
 
     // Make move on board
-    board->doMove(to_return, my_side);
+    board.doMove(&to_return, my_side);
+    startPondering(testingMinimax ? -1 : msLeft);
 
-    return to_return;
+    // The caller owns (and deletes) the returned move.
+    return new Move(to_return);
 
 }
 
-Move * Player::getRandomMove(vector<Move *> moves)
+Move Player::getRandomMove(MoveList &moves)
 {
     // Seed rand
     srand (time(NULL));
@@ -93,26 +353,26 @@ Move * Player::getRandomMove(vector<Move *> moves)
     return moves[r];
 }
 
-Move * Player::getHeuristicMove(vector<Move *> moves)
+Move Player::getHeuristicMove(MoveList &moves)
 {
-    Move * to_return;
+    Move to_return;
     int max_score = INT_MIN;
 
-    for (unsigned int i = 0; i < moves.size(); i++)
+    for (int i = 0; i < moves.size(); i++)
     {
-        Board * temp_board = board->copy();
-        temp_board->doMove(moves[i], my_side);
-        int this_score = temp_board->count(my_side) - 
-                            temp_board->count(opponent_side);
+        uint64_t flipped = board.doMove(&moves[i], my_side);
+        int this_score = board.count(my_side) - 
+                            board.count(opponent_side);
+        board.undoMove(&moves[i], flipped, my_side);
 
         // Increase corner value
-        if (temp_board->isCorner(moves[i]))
+        if (board.isCorner(&moves[i]))
         {
             this_score = INT_MAX;
         }
 
         // Decrease value for spaces right next to corner
-        if (temp_board->isNextToCorner(moves[i]))
+        if (board.isNextToCorner(&moves[i]))
         {
             if (this_score < 0)
                 this_score *= 3;
@@ -153,46 +413,46 @@ int Player::getOppMoveValue(Board * board, Move * move)
 }
 
 
-Move * Player::getTwoPlyMove(vector<Move *> moves)
+Move Player::getTwoPlyMove(MoveList &moves)
 {
-    Move * to_return;
+    Move to_return;
     int max_score = INT_MIN;
 
     // Go through all user possible moves
-    for (unsigned int i = 0; i < moves.size(); i++)
+    for (int i = 0; i < moves.size(); i++)
     {
-        Board * temp_board = board->copy();
-        temp_board->doMove(moves[i], my_side);
-
-        if (temp_board->isCorner(moves[i]))
+        if (board.isCorner(&moves[i]))
         {
             return moves[i];
         }
 
+        uint64_t flipped = board.doMove(&moves[i], my_side);
+
         // Do the same as before, since now we must calculate the heuristic 
         // for each opponent move (for every user move)
         int opp_min_score = INT_MAX;
 
         // Get opponent's possible moves for this specific move
-        vector<Move*> oppmoves = temp_board->getMoves(opponent_side);
+        MoveList oppmoves = board.getMoves(opponent_side);
         // If opponent cannot make any moves, we calculate heuristic now
         // and return nullptr for opponent move
-        if (oppmoves.size() == 0)
+        if (oppmoves.empty())
         {
-            opp_min_score = temp_board->count(my_side) - 
-                            temp_board->count(opponent_side);
+            opp_min_score = board.count(my_side) - 
+                            board.count(opponent_side);
         }
         else
         {
             // Go through all AI moves and pick lowest score
-            for (unsigned int j = 0; j < oppmoves.size(); j++)
+            for (int j = 0; j < oppmoves.size(); j++)
             {
                 // Make opponent move
-                Board * opp_temp_board = temp_board->copy();
-                opp_temp_board->doMove(oppmoves[j], opponent_side);
+                uint64_t opp_flipped = board.doMove(&oppmoves[j],
+                                                    opponent_side);
 
                 // Get heuristic for specific move
-                int this_score = getOppMoveValue(opp_temp_board, oppmoves[j]);
+                int this_score = getOppMoveValue(&board, &oppmoves[j]);
+                board.undoMove(&oppmoves[j], opp_flipped, opponent_side);
 
                 if (this_score < opp_min_score)
                 {
@@ -200,6 +460,7 @@ Move * Player::getTwoPlyMove(vector<Move *> moves)
                 }
             }
         }
+        board.undoMove(&moves[i], flipped, my_side);
 
         if (opp_min_score > max_score)
         {
@@ -212,150 +473,872 @@ Move * Player::getTwoPlyMove(vector<Move *> moves)
     return to_return;
 }
 
-Move * Player::getMinimax(Board * b, std::vector<Move *> m)
+/*
+ * Sets the deadline for this move's search. An msLeft of -1 means no time
+ * limit; the search then simply goes to maxDepth.
+ */
+void Player::startClock(Board * b, int msLeft)
 {
-    vector<int> scores(m.size(), 0);
-    int alpha = INT_MIN;
-    int beta = INT_MAX;
+    startMoveClock((msLeft < 0) ? -1 : getBudget(b, msLeft));
+}
+
+/*
+ * Sets the deadline to ms from now, or no time limit if ms is -1.
+ */
+void Player::startMoveClock(long ms)
+{
+    searchStart = chrono::steady_clock::now();
+    stop = false;
+    cancelled = false;
+    timed = (ms >= 0);
+    if (!timed)
+        return;
+
+    deadline = searchStart + chrono::milliseconds(ms);
+}
+
+/*
+ * Time (in ms) for the search of one move. The remaining time is spread over
+ * the moves we still have to make (about half of the empty squares), after
+ * setting aside the per-move overhead of the wrapper.
+ */
+long Player::getBudget(Board * b, int msLeft)
+{
+    int empties = 64 - b->countBlack() - b->countWhite();
+    int movesLeft = (empties + 1) / 2;
+    if (movesLeft < 1)
+        movesLeft = 1;
+
+    long usable = msLeft - (long) MOVE_OVERHEAD_MS * movesLeft;
+    if (usable < msLeft / 4)
+        usable = msLeft / 4;
 
-    for (unsigned int i = 0; i < m.size(); i++)
+    long budget = usable / movesLeft;
+    if (empties <= wldEmpties && usable / ENDGAME_TIME_SHARE > budget)
+        budget = usable / ENDGAME_TIME_SHARE;
+
+    return budget;
+}
+
+/*
+ * Gets the table and the move ordering history ready for a new search.
+ */
+void Player::newSearch()
+{
+    tt.newSearch();
+
+    // Let history from earlier moves fade
+    for (SearchThread &t : threads)
+    {
+        for (int s = 0; s < 2; s++)
+        {
+            for (int i = 0; i < 64; i++)
+            {
+                t.history[s][i] /= 2;
+            }
+        }
+    }
+}
+
+/*
+ * Forgets everything earlier searches learned: the table, the killer moves
+ * and the history. A search after this depends only on its own position, as
+ * analysis of unrelated positions needs.
+ */
+void Player::clearSearch()
+{
+    tt.clear();
+    for (unsigned int i = 0; i < threads.size(); i++)
     {
-        Board * copy = b->copy();
-        copy->doMove(m[i], my_side);
-        // cerr << "My move: " << m[i]->getX() << " " << m[i]->getY() << "\n";
-        scores[i] = getMinMove(copy, 3, alpha, beta);
-        // cerr << "Score: " << scores[i] << "\n";
+        threads[i] = SearchThread();
+        threads[i].id = i;
     }
+}
 
-    int max = 0;
-    int max_score = scores[0];
+/*
+ * Starts searching, in the background, our reply to the move the opponent is
+ * expected to make: the best move the last search found for them. There is
+ * no deadline until the opponent's move arrives.
+ */
+void Player::startPondering(int msLeft)
+{
+    if (!ponder || msLeft < 0)
+        return;
+
+    TTEntry entry;
+    if (!tt.probe(board.getHash(opponent_side), entry) || entry.move < 0)
+        return;
+    Move predicted(entry.move);
+    if (!board.checkMove(&predicted, opponent_side))
+        return;
+
+    ponderBoard = board;
+    ponderBoard.doMove(&predicted, opponent_side);
+    ponderMoves = ponderBoard.getMoves(my_side);
+    if (ponderMoves.empty())
+        return;
+
+    // The book answers that position at once anyway
+    int score;
+    if (book->isOpen() && book->getMove(ponderBoard.getStones(my_side),
+            ponderBoard.getStones(opponent_side), score) >= 0)
+        return;
+
+    ponderMove = predicted;
+    searchStart = chrono::steady_clock::now();
+    deadline = chrono::steady_clock::time_point::max();
+    timed = true;
+    stop = false;
+    cancelled = false;
+    ponderDone = false;
+    newSearch();
+    ponderThread = thread(&Player::ponderSearch, this);
+}
+
+void Player::ponderSearch()
+{
+    ponderReply = getMinimax(&ponderBoard, ponderMoves);
+    ponderDone = true;
+}
+
+/*
+ * Ends pondering once the opponent's move is known. On a hit the search
+ * keeps going until it finishes or this move's time is up, and its move is
+ * returned in "reply"; on a miss it is cancelled straight away. Returns true
+ * on a hit.
+ */
+bool Player::stopPondering(Move * opponentsMove, int msLeft, Move &reply)
+{
+    if (!ponderThread.joinable())
+        return false;
 
-    // Select maximum move
-    for (unsigned int i = 1; i < scores.size(); i++)
+    bool hit = (opponentsMove != nullptr && msLeft >= 0 &&
+                opponentsMove->getSquare() == ponderMove.getSquare());
+    chrono::steady_clock::time_point hitTime = chrono::steady_clock::now();
+    if (hit)
     {
-        if (scores[i] > max_score)
+        // The search thread owns the deadline, so keep this one here
+        chrono::steady_clock::time_point end =
+            hitTime + chrono::milliseconds(getBudget(&board, msLeft));
+        while (!ponderDone && chrono::steady_clock::now() < end)
         {
-            max = i;
-            max_score = scores[i];
+            this_thread::sleep_for(chrono::milliseconds(PONDER_POLL_MS));
         }
     }
 
-    // cerr << "MAX SCORE: " << scores[max] << "\n";
+    cancelled = true;
+    stop = true;
+    ponderThread.join();
 
-    return m[max];
+    if (hit)
+    {
+        searchStart = hitTime;
+        reply = ponderReply;
+    }
+    return hit;
 }
 
-int Player::getMaxMove(Board * b, int depth, int alpha, int beta)
+/*
+ * Returns true once the search has been told to stop. Only the main thread
+ * (id 0) reads the clock, every CLOCK_CHECK_NODES nodes; it stops the
+ * helpers once it runs past the deadline or finishes.
+ */
+bool Player::timeUp(SearchThread &t)
 {
-    vector<Move * > moves = b->getMoves(my_side);
-    vector<int> scores(moves.size(), 0);
+    if (stop.load(memory_order_relaxed))
+        return true;
 
-    // If depth reached
-    if (depth == 0)
+    t.nodes++;
+    if (t.id == 0 && timed && t.nodes % CLOCK_CHECK_NODES == 0 &&
+        chrono::steady_clock::now() >= deadline)
     {
-        return getScore(b);
+        stop = true;
     }
+    return stop.load(memory_order_relaxed);
+}
 
-    // If no possible moves
-    if (moves.size() == 0)
+#ifdef SEARCH_STATS
+/*
+ * Writes one JSON line describing the search for the move just chosen to
+ * statsFd (if it is not -1).
+ */
+void Player::reportStats(Move move, bool fromBook)
+{
+    if (statsFd < 0)
+        return;
+
+    double ms = chrono::duration<double, milli>(
+        chrono::steady_clock::now() - searchStart).count();
+    int empties = 64 - board.countBlack() - board.countWhite();
+
+    char line[8192];
+    int n = snprintf(line, sizeof(line),
+        "{\"side\":\"%s\",\"x\":%d,\"y\":%d,\"empties\":%d,"
+        "\"book\":%s,\"ponderHit\":%s,\"score\":%d,\"ms\":%.2f",
+        my_side == BLACK ? "black" : "white", move.getX(), move.getY(),
+        empties, fromBook ? "true" : "false", ponderHit ? "true" : "false",
+        lastScore, ms);
+
+    if (!fromBook)
     {
-        return getMinMove(b, depth - 1, alpha, beta);
+        int depth = iterationCount ? iterations[iterationCount - 1].depth : 0;
+        double ebf = 0;
+        if (iterationCount >= 2 && iterations[iterationCount - 2].nodes > 0)
+        {
+            ebf = (double) iterations[iterationCount - 1].nodes /
+                  iterations[iterationCount - 2].nodes;
+        }
+        n += snprintf(line + n, sizeof(line) - n,
+            ",\"nodes\":%ld,\"nps\":%.0f,\"evals\":%ld,\"cutoffs\":%ld,"
+            "\"firstMoveCutoffRate\":%.3f,\"ttProbes\":%ld,\"ttHits\":%ld,"
+            "\"ttCutoffs\":%ld,\"probCuts\":%ld,\"depth\":%d,\"ebf\":%.2f,"
+            "\"iterations\":[",
+            nodes, ms > 0 ? nodes * 1000 / ms : 0, stats.evals, stats.cutoffs,
+            stats.cutoffs ? (double) stats.firstMoveCutoffs / stats.cutoffs : 0,
+            stats.ttProbes, stats.ttHits, stats.ttCutoffs, stats.probCuts,
+            depth, ebf);
+        for (int i = 0; i < iterationCount && n < (int) sizeof(line) - 256; i++)
+        {
+            n += snprintf(line + n, sizeof(line) - n,
+                "%s{\"depth\":%d,\"nodes\":%ld,\"ms\":%.2f}",
+                i ? "," : "", iterations[i].depth, iterations[i].nodes,
+                iterations[i].ms);
+        }
+        n += snprintf(line + n, sizeof(line) - n,
+            "],\"endgame\":{\"nodes\":%ld,\"ms\":%.2f,\"solved\":%s}",
+            endgameNodes, endgameMs, endgameSolved ? "true" : "false");
     }
+    n += snprintf(line + n, sizeof(line) - n, "}\n");
 
-    for (unsigned int i = 0; i < moves.size(); i++)
+    if (write(statsFd, line, n) < 0)
     {
-        // cerr << "my move: " << moves[i]->getX() << " " << moves[i]->getY() << "\n";
-        Board * copy = b->copy();
-        copy->doMove(moves[i], my_side);
+        statsFd = -1;
+    }
+}
+#endif
 
-        scores[i] = getMinMove(copy, depth - 1, alpha, beta);
-        // cerr << "Max score: " << scores[i] << "\n";
+/*
+ * Iterative deepening: searches the root moves one ply deeper each time,
+ * trying the previous iteration's best move first, until maxDepth is reached
+ * or the time runs out. Returns the best move of the last completed
+ * iteration. Helper threads search the same position alongside, filling the
+ * shared transposition table; only the main thread's result is used.
+ */
+Move Player::getMinimax(Board * b, MoveList &m)
+{
+    lastScore = 0;
+    lastSolved = false;
+    nodes = 0;
+    STAT(stats = SearchStats());
+    STAT(iterationCount = 0);
+    STAT(endgameNodes = 0);
+    STAT(endgameMs = 0);
+    STAT(endgameSolved = false);
+    if (m.size() == 1)
+        return m[0];
+
+    for (SearchThread &t : threads)
+    {
+        t.board = *b;
+        t.state.set(*b);
+        t.nodes = 0;
+        STAT(t.stats = SearchStats());
+    }
 
-        // Alpha beta pruning
-        if (scores[i] > alpha)
-        {
-            alpha = scores[i];
-        }
-        if (alpha >= beta)
+    vector<thread> helpers;
+    for (unsigned int i = 1; i < threads.size(); i++)
+    {
+        helpers.push_back(thread(&Player::helperSearch, this, i, m));
+    }
+
+    SearchThread &t = threads[0];
+    int empties = 64 - b->countBlack() - b->countWhite();
+
+    // Timed searches keep deepening for as long as the clock allows. Close
+    // to the end a shallow search is enough to have a fallback move and the
+    // rest of the time goes to solving the endgame.
+    bool solving = !testingMinimax && empties <= wldEmpties;
+    int limit = timed ? empties : maxDepth;
+    if (solving && limit > ENDGAME_PRESEARCH_DEPTH)
+        limit = ENDGAME_PRESEARCH_DEPTH;
+
+    for (int depth = 1; depth <= limit; depth++)
+    {
+        STAT(long iterationNodes = t.nodes);
+        STAT(chrono::steady_clock::time_point iterationStart =
+                 chrono::steady_clock::now());
+
+        int score;
+        int max = getRootMove(t, m, depth, score);
+        if (max < 0)
+            break;
+
+        // Search the best move first in the next iteration.
+        Move best = m[max];
+        m.moveToFront(best);
+        lastScore = score;
+
+        STAT(IterationStats &it = iterations[iterationCount++]);
+        STAT(it.depth = depth);
+        STAT(it.nodes = t.nodes - iterationNodes);
+        STAT(it.ms = chrono::duration<double, milli>(
+                 chrono::steady_clock::now() - iterationStart).count());
+
+        // Deeper searches cannot see more than the rest of the game.
+        if (depth >= empties)
+            break;
+
+        // An iteration takes several times longer than the previous one, so
+        // do not start one that is unlikely to finish.
+        if (timed)
         {
-            return scores[i];
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (now - searchStart > (deadline - searchStart) / 2)
+                break;
         }
-        
     }
 
+    stop = true;
+    for (thread &helper : helpers)
+    {
+        helper.join();
+    }
+
+    for (SearchThread &h : threads)
+    {
+        nodes += h.nodes;
+        STAT(stats.add(h.stats));
+    }
+
+    if (solving)
+    {
+        solveEndgame(b, m, empties);
+    }
+
+    return m[0];
+}
+
+/*
+ * Solves the endgame from the root: exactly within endgameEmpties empties,
+ * otherwise only for win, loss or draw. If the solve finishes in time its
+ * best move goes to the front of m; otherwise m is left alone. So is it when
+ * a win/loss/draw solve finds every move losing: each one then failed low,
+ * and the solver's pick among them means nothing, so the midgame search's
+ * move (which may still set traps) is kept.
+ */
+void Player::solveEndgame(Board * b, MoveList &m, int empties)
+{
+    STAT(chrono::steady_clock::time_point start = chrono::steady_clock::now());
+    EndgameSolver solver(&tt);
+    solver.setCancelFlag(&cancelled);
+    if (timed)
+    {
+        solver.setDeadline(deadline);
+    }
+
+    int bound = (empties <= endgameEmpties) ? 64 : 1;
+    int best;
+    int score = solver.solve(b->getStones(my_side),
+                             b->getStones(opponent_side), -bound, bound,
+                             best);
+    nodes += solver.nodes;
+    STAT(endgameNodes = solver.nodes);
+    STAT(endgameMs = chrono::duration<double, milli>(
+             chrono::steady_clock::now() - start).count());
+    STAT(endgameSolved = !solver.aborted);
+
+    if (solver.aborted || best < 0 || (bound == 1 && score < 0))
+    {
+        return;
+    }
+
+    m.moveToFront(Move(best));
+    lastSolved = true;
+    if (score > 0)
+    {
+        lastScore = WIN_SCORE + score;
+    }
+    else if (score < 0)
+    {
+        lastScore = -WIN_SCORE + score;
+    }
+    else
+    {
+        lastScore = 0;
+    }
+}
+
+/*
+ * Iterative deepening on a helper thread until the main thread stops it.
+ * Odd helpers start a ply deeper, and each helper starts from a different
+ * root move, so the threads spread out over the tree instead of all
+ * searching the same nodes in the same order.
+ */
+void Player::helperSearch(int id, MoveList m)
+{
+    SearchThread &t = threads[id];
+    m.moveToFront(m[id % m.size()]);
+
+    int empties = 64 - t.board.countBlack() - t.board.countWhite();
+    int limit = timed ? empties : maxDepth;
+
+    for (int depth = 1 + id % 2; depth <= limit; depth++)
+    {
+        int score;
+        int max = getRootMove(t, m, depth, score);
+        if (max < 0)
+            break;
+        m.moveToFront(m[max]);
+    }
+}
+
+/*
+ * Searches every root move to the given depth (counting the root move itself)
+ * and returns the index of the best one, with its score in "score", or -1 if
+ * the search was stopped first. The first move gets the full window; the
+ * others are only proven worse with a null window, and re-searched if that
+ * fails.
+ */
+int Player::getRootMove(SearchThread &t, MoveList &m, int depth, int &score)
+{
+    return (my_side == BLACK) ? getRootMove<BLACK>(t, m, depth, score)
+                              : getRootMove<WHITE>(t, m, depth, score);
+}
+
+template <Side side>
+int Player::getRootMove(SearchThread &t, MoveList &m, int depth, int &score)
+{
+    const Side other = opponentOf(side);
+    Board * b = &t.board;
+    int alpha = -INF_SCORE;
+    int beta = INF_SCORE;
     int max = 0;
-    int max_score = scores[0];
-    for (unsigned int i = 1; i < scores.size(); i++)
+
+    for (int i = 0; i < m.size(); i++)
     {
-        if (scores[i] > max_score)
+        int sq = m[i].getSquare();
+        uint64_t flipped = b->doMove<side>(sq);
+        t.state.doMove<side>(flipped, sq);
+        // cerr << "My move: " << m[i].getX() << " " << m[i].getY() << "\n";
+        int s;
+        if (i == 0)
+        {
+            s = -pvs<other>(t, depth - 1, -beta, -alpha, 1);
+        }
+        else
+        {
+            s = -pvs<other>(t, depth - 1, -alpha - 1, -alpha, 1);
+            if (s > alpha && s < beta)
+            {
+                s = -pvs<other>(t, depth - 1, -beta, -alpha, 1);
+            }
+        }
+        b->undoMove<side>(sq, flipped);
+        t.state.undoMove<side>(flipped, sq);
+        // cerr << "Score: " << s << "\n";
+
+        if (stop.load(memory_order_relaxed))
+            return -1;
+
+        // Select maximum move
+        if (i == 0 || s > alpha)
         {
             max = i;
-            max_score = scores[i];
+            alpha = s;
         }
     }
 
-    // cerr << "FINAL MAX SCORE: " << scores[max] << "\n";
+    // cerr << "MAX SCORE: " << alpha << "\n";
 
-    return scores[max];
+    score = alpha;
+    return max;
 }
 
-int Player::getMinMove(Board * b, int depth, int alpha, int beta)
+/*
+ * Looks the position up in the transposition table. Returns true if the
+ * stored result settles the value of this node given the window, with the
+ * score in "score"; otherwise leaves the stored best move (or -1) in ttMove.
+ * Untimed searches only trust results of exactly the same depth, which every
+ * thread computes identically.
+ */
+bool Player::probeTable(SearchThread &t, uint64_t key, int depth, int alpha,
+                        int beta, int &score, int &ttMove)
 {
-    vector<Move * > moves = b->getMoves(opponent_side);
-    vector<int> scores(moves.size(), 0);
+    TTEntry entry;
+    ttMove = -1;
+    STAT(t.stats.ttProbes++);
+    if (!tt.probe(key, entry))
+    {
+        return false;
+    }
+
+    STAT(t.stats.ttHits++);
+    ttMove = entry.move;
+
+    if (entry.depth == depth || (timed && entry.depth > depth))
+    {
+        score = entry.score;
+        if (entry.bound == BOUND_EXACT ||
+            (entry.bound == BOUND_LOWER && score >= beta) ||
+            (entry.bound == BOUND_UPPER && score <= alpha))
+        {
+            STAT(t.stats.ttCutoffs++);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Stores a node's result, classifying it against the window it was searched
+ * with. Results of a stopped search are not trustworthy and are dropped.
+ */
+void Player::storeTable(uint64_t key, int depth, int alpha, int beta,
+                        int score, int move)
+{
+    if (stop.load(memory_order_relaxed))
+    {
+        return;
+    }
+
+    Bound bound = BOUND_EXACT;
+    if (score <= alpha)
+    {
+        bound = BOUND_UPPER;
+    }
+    else if (score >= beta)
+    {
+        bound = BOUND_LOWER;
+    }
+    tt.store(key, depth, score, bound, move);
+}
+
+/*
+ * Negamax principal variation search: returns the score of the position for
+ * the side to move. The first (best-ordered) move is searched with the full
+ * window and the rest with a null window, re-searching only those that turn
+ * out better. It is compiled once for each side to move, so the side never
+ * needs testing at run time.
+ */
+template <Side side>
+int Player::pvs(SearchThread &t, int depth, int alpha, int beta, int ply)
+{
+    const Side other = opponentOf(side);
+
+    // Out of time; the result is thrown away
+    if (timeUp(t))
+    {
+        return 0;
+    }
+
+    Board * b = &t.board;
 
     // If depth reached
     if (depth == 0)
     {
-        return getScore(b);
+        STAT(t.stats.evals++);
+        return getScore<side>(t);
+    }
+
+    // Seen before?
+    uint64_t key = t.state.getHash<side>();
+    int score, ttMove;
+    if (probeTable(t, key, depth, alpha, beta, score, ttMove))
+    {
+        return score;
+    }
+
+    // Shallow searches may show that this one is all but certain to fail
+    // high or low
+    if (probCut<side>(t, depth, alpha, beta, ply, score))
+    {
+        return score;
+    }
+
+    MoveList moves(b->getMoveMask<side>());
+
+    // If no possible moves, pass, unless the game is over
+    if (moves.empty())
+    {
+        if (b->getMoveMask<other>() == 0)
+        {
+            return getFinalScore(b, side);
+        }
+        score = -pvs<other>(t, depth - 1, -beta, -alpha, ply + 1);
+        storeTable(key, depth, alpha, beta, score, -1);
+        return score;
     }
 
-    // If no possible moves
-    if (moves.size() == 0)
+    int keys[MoveList::CAPACITY];
+    orderMoves<side>(t, moves, keys, ttMove, depth, ply);
+
+    int alpha0 = alpha;
+    int best_score = -INF_SCORE;
+    int best = -1;
+    for (int i = 0; i < moves.size(); i++)
     {
-        return getMaxMove(b, depth - 1, alpha, beta);
+        pickNextMove(moves, keys, i);
+
+        int sq = moves[i].getSquare();
+        uint64_t flipped = b->doMove<side>(sq);
+        t.state.doMove<side>(flipped, sq);
+        if (i == 0)
+        {
+            score = -pvs<other>(t, depth - 1, -beta, -alpha, ply + 1);
+        }
+        else
+        {
+            score = -pvs<other>(t, depth - 1, -alpha - 1, -alpha, ply + 1);
+            if (score > alpha && score < beta)
+            {
+                score = -pvs<other>(t, depth - 1, -beta, -alpha, ply + 1);
+            }
+        }
+        b->undoMove<side>(sq, flipped);
+        t.state.undoMove<side>(flipped, sq);
+
+        if (score > best_score)
+        {
+            best_score = score;
+            best = moves[i].getSquare();
+        }
+
+        // Alpha beta pruning
+        if (score > alpha)
+        {
+            alpha = score;
+        }
+        if (alpha >= beta)
+        {
+            recordCutoff(t, side, moves[i], depth, ply, i);
+            break;
+        }
     }
 
-    for (unsigned int i = 0; i < moves.size(); i++)
+    storeTable(key, depth, alpha0, beta, best_score, best);
+    return best_score;
+}
+
+/*
+ * Multi-ProbCut: a search to "depth" scores about a * s + b, where s is the
+ * score of a shallow search of the same position. If the shallow search
+ * shows, with a null window, that the deep score is beyond the window by
+ * more than the selectivity level's number of standard deviations, the
+ * node is cut with score alpha or beta. Cheaper checks are tried first.
+ * Returns true on a cut. Scores near the end of the game are left alone, as
+ * they are exact rather than evaluations.
+ */
+template <Side side>
+bool Player::probCut(SearchThread &t, int depth, int alpha, int beta, int ply,
+                     int &score)
+{
+    Board * b = &t.board;
+    int discs = b->countBlack() + b->countWhite();
+    if (selectivity <= 0 || testingMinimax || depth >= 64 - discs ||
+        alpha < -EVAL_MAX || beta > EVAL_MAX)
     {
-        // cerr << "\topp move: " << moves[i]->getX() << " " << moves[i]->getY() << "\n";
-        Board * copy = b->copy();
-        copy->doMove(moves[i], opponent_side);
+        return false;
+    }
+
+    ProbCutCheck *checks = probcut->getChecks(PatternEval::getPhase(discs),
+                                             depth);
+    if (checks == nullptr)
+    {
+        return false;
+    }
+
+    double sigmas = ProbCut::threshold(selectivity);
+    for (int c = 0; c < PROBCUT_CHECKS; c++)
+    {
+        const ProbCutCheck &check = checks[c];
+        if (check.sigma <= 0 || check.a <= 0)
+        {
+            continue;
+        }
+
+        // Shallow scores that predict a deep score of at least beta, or of
+        // at most alpha
+        double margin = sigmas * check.sigma;
+        int high = (int) ceil((beta + margin - check.b) / check.a);
+        int low = (int) floor((alpha - margin - check.b) / check.a);
+
+        if (high < EVAL_MAX &&
+            pvs<side>(t, check.shallow, high - 1, high, ply) >= high)
+        {
+            STAT(t.stats.probCuts++);
+            score = beta;
+            return true;
+        }
+        if (low > -EVAL_MAX &&
+            pvs<side>(t, check.shallow, low, low + 1, ply) <= low)
+        {
+            STAT(t.stats.probCuts++);
+            score = alpha;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Score of a full-width search (no ProbCut) of the position to the given
+ * depth, for the side to move. Used to fit the ProbCut parameters.
+ */
+int Player::getSearchScore(Board * b, Side side, int depth)
+{
+    SearchThread &t = threads[0];
+    t.board = *b;
+    t.state.set(*b);
+    int level = selectivity;
+    selectivity = 0;
+    int score = (side == BLACK)
+        ? pvs<BLACK>(t, depth, -INF_SCORE, INF_SCORE, 0)
+        : pvs<WHITE>(t, depth, -INF_SCORE, INF_SCORE, 0);
+    selectivity = level;
+    return score;
+}
+
+/*
+ * Gives every move a sort key: the transposition table move first, then the
+ * two killer moves of this ply, then the rest by history score. Far enough
+ * from the leaves, moves that leave the opponent fewer replies go first;
+ * the replies to every move are generated together, as one batch.
+ */
+template <Side side>
+void Player::orderMoves(SearchThread &t, MoveList &moves, int *keys,
+                        int ttMove, int depth, int ply)
+{
+    const Side other = opponentOf(side);
+    Board * b = &t.board;
+    bool useMobility = (depth >= MOBILITY_ORDER_DEPTH);
+    int k = (ply < MAX_PLY) ? ply : MAX_PLY - 1;
 
-        scores[i] = getMaxMove(copy, depth - 1, alpha, beta);
-        // cerr << "\tmin score: " << scores[i] << "\n";
+    uint64_t replies[MoveList::CAPACITY];
+    if (useMobility)
+    {
+        uint64_t P = b->getStones<side>();
+        uint64_t O = b->getStones<other>();
+        uint64_t mine[MoveList::CAPACITY], theirs[MoveList::CAPACITY];
+        for (int i = 0; i < moves.size(); i++)
+        {
+            uint64_t placed = 1ULL << moves[i].getSquare();
+            uint64_t flipped = flips(P, O, placed);
+            mine[i] = P | flipped | placed;
+            theirs[i] = O & ~flipped;
+        }
+        legalMovesBatch(theirs, mine, replies, moves.size());
+    }
 
-        // Alpha Beta pruning
-        if (scores[i] < beta)
+    for (int i = 0; i < moves.size(); i++)
+    {
+        int sq = moves[i].getSquare();
+        if (sq == ttMove)
         {
-            beta = scores[i];
+            keys[i] = ORDER_TT;
         }
-        if (beta <= alpha)
+        else if (sq == t.killers[k][0])
         {
-            return scores[i];
+            keys[i] = ORDER_KILLER;
+        }
+        else if (sq == t.killers[k][1])
+        {
+            keys[i] = ORDER_KILLER - 1;
+        }
+        else
+        {
+            keys[i] = t.history[side][sq];
+            if (useMobility)
+            {
+                int mobility = __builtin_popcountll(replies[i]);
+                keys[i] -= mobility << HISTORY_BITS;
+            }
         }
     }
+}
 
-    int min = 0;
-    int min_score = scores[0];
-    for (unsigned int i = 1; i < scores.size(); i++)
+/*
+ * Swaps the best remaining move (by sort key) into position i. Sorting
+ * lazily like this saves work when an early move causes a cutoff.
+ */
+void Player::pickNextMove(MoveList &moves, int *keys, int i)
+{
+    int best = i;
+    for (int j = i + 1; j < moves.size(); j++)
     {
-        if (scores[i] < min_score)
+        if (keys[j] > keys[best])
         {
-            min = i;
-            min_score = scores[i];
+            best = j;
         }
     }
+    if (best != i)
+    {
+        Move m = moves[i];
+        moves[i] = moves[best];
+        moves[best] = m;
+        int key = keys[i];
+        keys[i] = keys[best];
+        keys[best] = key;
+    }
+}
+
+/*
+ * Remembers a move that caused a beta cutoff as a killer for its ply and
+ * credits it in the history table, and counts the cutoff.
+ */
+void Player::recordCutoff(SearchThread &t, Side side, Move m, int depth,
+                          int ply, int index)
+{
+    STAT(t.stats.cutoffs++);
+    STAT(if (index == 0) t.stats.firstMoveCutoffs++);
+
+    int k = (ply < MAX_PLY) ? ply : MAX_PLY - 1;
+    if (t.killers[k][0] != m.getSquare())
+    {
+        t.killers[k][1] = t.killers[k][0];
+        t.killers[k][0] = m.getSquare();
+    }
+
+    int &h = t.history[side][m.getSquare()];
+    h += depth * depth;
+    if (h >= HISTORY_MAX)
+    {
+        // Halve everything so the table keeps its relative order.
+        for (int s = 0; s < 2; s++)
+            for (int i = 0; i < 64; i++)
+                t.history[s][i] /= 2;
+    }
+}
 
-    // cerr << "\tMIN OVERALL SCORE: " << scores[min] << "\n";
+/*
+ * Score of a finished game for the given side: any win beats any position
+ * that is still being played, and bigger wins are better.
+ */
+int Player::getFinalScore(Board * b, Side side)
+{
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    int diff = b->count(side) - b->count(other);
 
-    return scores[min];
+    // test_minimax checks the search with the plain disc difference
+    if (testingMinimax || diff == 0)
+    {
+        return diff;
+    }
+    return (diff > 0) ? WIN_SCORE + diff : -WIN_SCORE + diff;
 }
 
-int Player::getScore(Board * b)
+template <Side side>
+int Player::getScore(SearchThread &t)
 {
-    return b->getWeightedScore(my_side);
+    const Side other = opponentOf(side);
+    Board * b = &t.board;
+
+    // test_minimax checks the search with the plain disc difference
+    if (testingMinimax)
+    {
+        return b->count(side) - b->count(other);
+    }
 
-    // return b->count(my_side) - b->count(opponent_side);
+    return eval->evaluate<side>(t.state.patterns, b->getStones<side>(),
+                               b->getStones<other>());
 }
 
@@ -4,36 +4,235 @@
 #include <iostream>
 #include <cstdlib>
 #include <climits>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
 #include "common.hpp"
 #include "board.hpp"
+#include "ttable.hpp"
+#include "eval.hpp"
+#include "book.hpp"
+#include "probcut.hpp"
 using namespace std;
 
+// Deepest ply (from the root) that has its own killer moves
+#define MAX_PLY 128
+
+// Score bounds: no evaluation reaches WIN_SCORE, which only finished games
+// get (plus or minus their disc difference), and nothing reaches INF_SCORE.
+#define WIN_SCORE 100000
+#define INF_SCORE 1000000
+
+// Search statistics are only collected in builds with SEARCH_STATS defined;
+// otherwise STAT() statements compile to nothing.
+#ifdef SEARCH_STATS
+#define STAT(...) __VA_ARGS__
+#else
+#define STAT(...)
+#endif
+
+/*
+ * What a search did, counted per thread and summed over threads per move.
+ * The ratio of first-move cutoffs to cutoffs shows how good the move ordering
+ * is.
+ */
+struct SearchStats {
+    long evals;
+    long cutoffs;
+    long firstMoveCutoffs;
+    long ttProbes;
+    long ttHits;
+    long ttCutoffs;
+    long probCuts;
+
+    SearchStats();
+    void add(const SearchStats &s);
+};
+
+// One completed iteration of the main thread's iterative deepening
+struct IterationStats {
+    int depth;
+    long nodes;
+    double ms;
+};
+
+/*
+ * Search state private to one search thread: its own copy of the board, with
+ * its hash and pattern indices, its move ordering tables and its counters.
+ */
+struct SearchThread {
+    int id;
+    Board board;
+    BoardState state;
+
+    long nodes;
+    SearchStats stats;
+
+    // Two killer moves per ply and a history score per side and square,
+    // both kept across moves of the game.
+    int killers[MAX_PLY][2];
+    int history[2][64];
+
+    SearchThread();
+};
+
 class Player {
 
 public:
     Player(Side side);
+    Player(Side side, const Player *tables, int hashMB, int threadCount);
     ~Player();
 
     Move *doMove(Move *opponentsMove, int msLeft);
-    Move *getRandomMove(vector<Move*> moves);
-    Move *getHeuristicMove(vector<Move*> moves);
-    Move *getTwoPlyMove(vector<Move *> moves);
+    Move getRandomMove(MoveList &moves);
+    Move getHeuristicMove(MoveList &moves);
+    Move getTwoPlyMove(MoveList &moves);
     int getOppMoveValue(Board * board, Move * move);
 
     // Minimax methods
-    Move *getMinimax(Board * b, std::vector<Move *> m);
-    int getMaxMove(Board * b, int depth, int alpha, int beta);
-    int getMinMove(Board * b, int depth, int alpha, int beta);
-    int getScore(Board * b);
+    Move getMinimax(Board * b, MoveList &m);
+    void helperSearch(int id, MoveList m);
+    void solveEndgame(Board * b, MoveList &m, int empties);
+    int getRootMove(SearchThread &t, MoveList &m, int depth, int &score);
+
+    // The search proper, specialized for the side to move
+    template <Side side>
+    int getRootMove(SearchThread &t, MoveList &m, int depth, int &score);
+    template <Side side>
+    int pvs(SearchThread &t, int depth, int alpha, int beta, int ply);
+    template <Side side>
+    bool probCut(SearchThread &t, int depth, int alpha, int beta, int ply,
+                 int &score);
+    template <Side side>
+    void orderMoves(SearchThread &t, MoveList &moves, int *keys, int ttMove,
+                    int depth, int ply);
+    template <Side side> int getScore(SearchThread &t);
+
+    int getSearchScore(Board * b, Side side, int depth);
+    void pickNextMove(MoveList &moves, int *keys, int i);
+    void recordCutoff(SearchThread &t, Side side, Move m, int depth, int ply,
+                      int index);
+    int getFinalScore(Board * b, Side side);
+    bool probeTable(SearchThread &t, uint64_t key, int depth, int alpha,
+                    int beta, int &score, int &ttMove);
+    void storeTable(uint64_t key, int depth, int alpha, int beta,
+                    int score, int move);
+
+    // Time management
+    void startClock(Board * b, int msLeft);
+    void startMoveClock(long ms);
+    long getBudget(Board * b, int msLeft);
+    bool timeUp(SearchThread &t);
+    void newSearch();
+    void clearSearch();
+
+    // Pondering
+    void startPondering(int msLeft);
+    bool stopPondering(Move * opponentsMove, int msLeft, Move &reply);
+    void ponderSearch();
+
+#ifdef SEARCH_STATS
+    void reportStats(Move move, bool fromBook);
+#endif
 
     void setBoard(Board * board);
+    void setSide(Side side);
+    void setThreads(int n);
+    bool loadWeights(const char *path);
+    bool loadBook(const char *path);
+    bool loadProbCut(const char *path);
 
     // Flag to tell if the player is running within the test_minimax context
     bool testingMinimax;
 
+    // Keeps the "Playing as" and "Loaded" messages off stderr, for programs
+    // that run many players at once
+    static bool quiet;
+
+    // Depth searched to when there is no time limit (or when testing)
+    int maxDepth;
+
+    // With this many empty squares or fewer the endgame is solved exactly;
+    // with up to wldEmpties it is solved for win, loss or draw only.
+    int endgameEmpties;
+    int wldEmpties;
+
+    // How aggressively the midgame search prunes moves that shallow searches
+    // say are very unlikely to matter (Multi-ProbCut), from 0 (never) to
+    // PROBCUT_LEVELS.
+    int selectivity;
+
+    // Per-move search clock; a timed search gives up once it passes the
+    // deadline and plays the best move of the last completed iteration.
+    // Untimed searches are deterministic: they only take exact-depth results
+    // from the table, so extra threads cannot change their outcome. That
+    // holds for full-width searches (selectivity 0) only: ProbCut's cuts
+    // depend on the search window, which the other threads' table moves can
+    // change.
+    bool timed;
+    atomic<bool> stop;
+    chrono::steady_clock::time_point searchStart;
+    chrono::steady_clock::time_point deadline;
+
+    // When set (and the game is timed), each move is followed by a search
+    // of our reply to the opponent's expected move, run in the background
+    // while the opponent thinks. If the opponent plays that move the search
+    // carries on as this move's search; otherwise it is cancelled, and only
+    // what it left in the table is of use. "cancelled" also stops an endgame
+    // solve. Nothing else may touch the player while it ponders.
+    bool ponder;
+    thread ponderThread;
+    atomic<bool> ponderDone;
+    atomic<bool> cancelled;
+    Move ponderMove;
+    Move ponderReply;
+    Board ponderBoard;
+    MoveList ponderMoves;
+    bool ponderHit;
+
+    // Nodes searched for the last move, over all threads and the endgame
+    // solver
+    long nodes;
+
+    // Statistics for the last move (SEARCH_STATS builds only), written as
+    // one JSON line per move to the file descriptor statsFd unless it is -1
+    SearchStats stats;
+    IterationStats iterations[MAX_PLY];
+    int iterationCount;
+    long endgameNodes;
+    double endgameMs;
+    bool endgameSolved;
+    int statsFd;
+
+    // Score of the last move chosen by getMinimax, for the side to move, and
+    // whether it comes from an endgame solve rather than a search
+    int lastScore;
+    bool lastSolved;
+
+    // Position evaluation, with trained weights if a weights file was found
+    shared_ptr<PatternEval> eval;
+
+    // Multi-ProbCut parameters, fitted ones if a parameter file was found
+    shared_ptr<ProbCut> probcut;
+
+    // Opening moves, if a book file was found
+    shared_ptr<OpeningBook> book;
+
+    // (Searches only read these three, so players serving many games at
+    // once can share them; loading a file replaces a player's own copy.)
+
+    // Results of earlier searches, shared by all threads and moves
+    TranspositionTable tt;
+
+    // One entry per thread searching each move (Lazy SMP: all threads
+    // search the same tree and share results through the table)
+    vector<SearchThread> threads;
+
     Side my_side;
     Side opponent_side;
-    Board * board;
+    Board board;
 };
 
 #endif
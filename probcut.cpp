@@ -0,0 +1,125 @@
+#include <fstream>
+#include <cstring>
+#include "probcut.hpp"
+
+// Parameter file format: a header with the magic bytes, the version and the
+// table dimensions, then the checks in phase, depth, check order.
+#define PROBCUT_MAGIC "OTHP"
+#define PROBCUT_VERSION 1
+
+// Default fit, from probcutfit over 600 random positions searched to depth
+// 11: deep scores run about 1.21 times the shallow ones, and sigma grows with
+// the depth gap and the phase and shrinks as the shallow search gets deeper.
+#define DEFAULT_A 1.21
+#define DEFAULT_SIGMA_BASE -127.0
+#define DEFAULT_SIGMA_GAP 170.0
+#define DEFAULT_SIGMA_SHALLOW -132.0
+#define DEFAULT_SIGMA_PHASE 156.0
+#define DEFAULT_SIGMA_MIN EVAL_SCALE
+
+// Cut thresholds (in standard deviations of the fit) of each selectivity
+// level: level 1 prunes only lines that a deep search would cut with about
+// 99% confidence, level 5 with about 80%.
+static constexpr double THRESHOLDS[PROBCUT_LEVELS + 1] = {
+    0, 2.6, 2.0, 1.5, 1.1, 0.85
+};
+
+ProbCut::ProbCut() {
+    setDefaults();
+}
+
+ProbCut::~ProbCut() {
+
+}
+
+/*
+ * Depth of the given check's shallow search before a search to "depth":
+ * about a quarter as deep for the last check, with the same parity (the
+ * evaluation swings between odd and even depths), and two plies less for
+ * each check before it. Negative if there is no such check.
+ */
+int ProbCut::shallowDepth(int depth, int check) {
+    int shallow = 2 * (depth / 4) + (depth & 1);
+    return shallow - 2 * (PROBCUT_CHECKS - 1 - check);
+}
+
+/*
+ * How many standard deviations a shallow score has to be beyond the bound to
+ * prune, at the given selectivity level.
+ */
+double ProbCut::threshold(int level) {
+    if (level <= 0) return 0;
+    if (level > PROBCUT_LEVELS) level = PROBCUT_LEVELS;
+    return THRESHOLDS[level];
+}
+
+/*
+ * The checks for a search of the given depth in the given phase, or nullptr
+ * if that depth is never pruned.
+ */
+ProbCutCheck *ProbCut::getChecks(int phase, int depth) {
+    if (depth < PROBCUT_MIN_DEPTH || depth > PROBCUT_MAX_DEPTH) return nullptr;
+    return checks[phase][depth];
+}
+
+void ProbCut::setDefaults() {
+    memset(checks, 0, sizeof(checks));
+    for (int p = 0; p < EVAL_PHASES; p++) {
+        for (int d = PROBCUT_MIN_DEPTH; d <= PROBCUT_MAX_DEPTH; d++) {
+            for (int c = 0; c < PROBCUT_CHECKS; c++) {
+                ProbCutCheck &check = checks[p][d][c];
+                check.shallow = shallowDepth(d, c);
+                if (check.shallow < 0) continue;
+                check.a = DEFAULT_A;
+                check.b = 0;
+                check.sigma = DEFAULT_SIGMA_BASE +
+                              DEFAULT_SIGMA_GAP * (d - check.shallow) +
+                              DEFAULT_SIGMA_SHALLOW * check.shallow +
+                              DEFAULT_SIGMA_PHASE * p;
+                if (check.sigma < DEFAULT_SIGMA_MIN)
+                    check.sigma = DEFAULT_SIGMA_MIN;
+            }
+        }
+    }
+}
+
+/*
+ * Loads parameters from a file written by save(). Returns false, keeping the
+ * current parameters, if the file is missing or made for other tables.
+ */
+bool ProbCut::load(const char *path) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+
+    char magic[4];
+    uint32_t header[4];
+    in.read(magic, 4);
+    in.read((char *) header, sizeof(header));
+    if (!in || memcmp(magic, PROBCUT_MAGIC, 4) != 0 ||
+        header[0] != PROBCUT_VERSION || header[1] != EVAL_PHASES ||
+        header[2] != PROBCUT_MAX_DEPTH || header[3] != PROBCUT_CHECKS) {
+        return false;
+    }
+
+    ProbCutCheck loaded[EVAL_PHASES][PROBCUT_MAX_DEPTH + 1][PROBCUT_CHECKS];
+    in.read((char *) loaded, sizeof(loaded));
+    if (!in) return false;
+
+    memcpy(checks, loaded, sizeof(checks));
+    return true;
+}
+
+/*
+ * Writes the parameters to a file in the format load() reads.
+ */
+bool ProbCut::save(const char *path) {
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+
+    uint32_t header[4] = { PROBCUT_VERSION, EVAL_PHASES, PROBCUT_MAX_DEPTH,
+                           PROBCUT_CHECKS };
+    out.write(PROBCUT_MAGIC, 4);
+    out.write((const char *) header, sizeof(header));
+    out.write((const char *) checks, sizeof(checks));
+    return (bool) out;
+}
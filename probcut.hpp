@@ -0,0 +1,58 @@
+#ifndef __PROBCUT_H__
+#define __PROBCUT_H__
+
+#include "common.hpp"
+#include "eval.hpp"
+using namespace std;
+
+// Deepest search that ProbCut prunes; deeper nodes are always searched in
+// full.
+#define PROBCUT_MAX_DEPTH 24
+
+// Shallowest search that ProbCut prunes.
+#define PROBCUT_MIN_DEPTH 3
+
+// Shallow searches tried, cheapest first, before each deep one.
+#define PROBCUT_CHECKS 2
+
+// Highest selectivity level; 0 turns ProbCut off.
+#define PROBCUT_LEVELS 5
+
+/*
+ * How well a shallow search predicts a deep one: the deep score is about
+ * a * (shallow score) + b, with residuals of standard deviation sigma (all
+ * scores in evaluation units). A sigma of 0 marks a check that is not used.
+ */
+struct ProbCutCheck {
+    int shallow;
+    float a;
+    float b;
+    float sigma;
+};
+
+/*
+ * Multi-ProbCut parameters: for every game phase and depth, the shallow
+ * searches whose results are good enough predictors of the deep search to
+ * prune with. Parameters are fitted offline by probcutfit.
+ */
+class ProbCut {
+
+private:
+    ProbCutCheck checks[EVAL_PHASES][PROBCUT_MAX_DEPTH + 1][PROBCUT_CHECKS];
+
+    void setDefaults();
+
+public:
+    ProbCut();
+    ~ProbCut();
+
+    bool load(const char *path);
+    bool save(const char *path);
+
+    ProbCutCheck *getChecks(int phase, int depth);
+
+    static int shallowDepth(int depth, int check);
+    static double threshold(int level);
+};
+
+#endif
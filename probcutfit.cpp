@@ -0,0 +1,207 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "common.hpp"
+#include "board.hpp"
+#include "player.hpp"
+#include "probcut.hpp"
+using namespace std;
+
+// Fewest samples a regression is fitted from; phases with fewer borrow the
+// samples of neighbouring phases.
+#define MIN_SAMPLES 40
+
+// Positions are sampled from random games between these numbers of discs.
+#define MIN_DISCS 8
+#define MAX_DISCS 54
+
+/*
+ * One logged position: its number of discs and its full-width search score
+ * at each depth from 0 up.
+ */
+struct Sample {
+    int discs;
+    vector<int> scores;
+};
+
+/*
+ * Plays random moves from the start up to a random number of discs. Returns
+ * false if the game ended first.
+ */
+static bool randomPosition(Board &board, Side &side) {
+    int discs = MIN_DISCS + rand() % (MAX_DISCS - MIN_DISCS + 1);
+    side = BLACK;
+    while (board.countBlack() + board.countWhite() < discs) {
+        MoveList moves = board.getMoves(side);
+        if (moves.empty()) {
+            if (!board.hasMoves(opponentOf(side))) return false;
+        } else {
+            board.doMove(&moves[rand() % moves.size()], side);
+        }
+        side = opponentOf(side);
+    }
+    return board.hasMoves(side);
+}
+
+/*
+ * Searches random positions to every depth up to maxDepth (stopping short of
+ * the end of the game) and appends one line per position to the log:
+ * the number of discs, then the score at each depth from 0.
+ */
+static int collect(const char *path, int positions, int maxDepth) {
+    ofstream log(path, ios::app);
+    if (!log) {
+        cerr << "Could not open " << path << endl;
+        return 1;
+    }
+
+    Player player(BLACK);
+    for (int i = 0; i < positions; i++) {
+        Board board;
+        Side side;
+        if (!randomPosition(board, side)) {
+            i--;
+            continue;
+        }
+
+        int discs = board.countBlack() + board.countWhite();
+        int depths = min(maxDepth, 63 - discs);
+        player.startClock(&board, -1);
+        player.tt.newSearch();
+
+        log << discs;
+        for (int d = 0; d <= depths; d++) {
+            log << " " << player.getSearchScore(&board, side, d);
+        }
+        log << endl;
+        cerr << "Position " << i + 1 << " of " << positions << ": " << discs
+             << " discs" << endl;
+    }
+    return 0;
+}
+
+/*
+ * Least squares fit of deep = a * shallow + b over the samples of the given
+ * phases that reach the deep depth, with the standard deviation of the
+ * residuals. Returns the number of samples used.
+ */
+static int fit(const vector<Sample> &samples, int phaseLo, int phaseHi,
+               int shallow, int deep, ProbCutCheck &check) {
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (const Sample &s : samples) {
+        int phase = PatternEval::getPhase(s.discs);
+        if (phase < phaseLo || phase > phaseHi ||
+            (int) s.scores.size() <= deep) {
+            continue;
+        }
+        double x = s.scores[shallow], y = s.scores[deep];
+        n++;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    if (n < MIN_SAMPLES) return n;
+
+    double var = n * sxx - sx * sx;
+    check.a = (var > 0) ? (n * sxy - sx * sy) / var : 1;
+    check.b = (sy - check.a * sx) / n;
+
+    double ss = 0;
+    for (const Sample &s : samples) {
+        int phase = PatternEval::getPhase(s.discs);
+        if (phase < phaseLo || phase > phaseHi ||
+            (int) s.scores.size() <= deep) {
+            continue;
+        }
+        double r = s.scores[deep] - (check.a * s.scores[shallow] + check.b);
+        ss += r * r;
+    }
+    check.sigma = sqrt(ss / (n - 2));
+    return n;
+}
+
+/*
+ * Fits every check of every phase and depth that the log has data for and
+ * writes the parameters; the rest keep their built-in values.
+ */
+static int fitLog(const char *logPath, const char *outPath) {
+    ifstream log(logPath);
+    if (!log) {
+        cerr << "Could not open " << logPath << endl;
+        return 1;
+    }
+
+    vector<Sample> samples;
+    string line;
+    while (getline(log, line)) {
+        istringstream in(line);
+        Sample s;
+        int score;
+        if (!(in >> s.discs)) continue;
+        while (in >> score) s.scores.push_back(score);
+        samples.push_back(s);
+    }
+    cerr << "Read " << samples.size() << " positions" << endl;
+
+    ProbCut probcut;
+    for (int p = 0; p < EVAL_PHASES; p++) {
+        for (int d = PROBCUT_MIN_DEPTH; d <= PROBCUT_MAX_DEPTH; d++) {
+            ProbCutCheck *checks = probcut.getChecks(p, d);
+            for (int c = 0; c < PROBCUT_CHECKS; c++) {
+                ProbCutCheck &check = checks[c];
+                if (check.shallow < 0) continue;
+
+                // Widen the range of phases until there are enough samples
+                int n = 0;
+                for (int w = 0; w < EVAL_PHASES && n < MIN_SAMPLES; w++) {
+                    n = fit(samples, p - w, p + w, check.shallow, d, check);
+                }
+                if (n < MIN_SAMPLES) continue;
+
+                cout << "phase " << p << " depth " << d << " from "
+                     << check.shallow << ": a " << check.a << " b " << check.b
+                     << " sigma " << check.sigma << " (" << n << " samples)"
+                     << endl;
+            }
+        }
+    }
+
+    if (!probcut.save(outPath)) {
+        cerr << "Could not write " << outPath << endl;
+        return 1;
+    }
+    cerr << "Wrote " << outPath << endl;
+    return 0;
+}
+
+/*
+ * Fits the Multi-ProbCut parameters offline, in two steps: "collect" logs
+ * full-width search scores of random positions at a range of depths, and
+ * "fit" regresses deep scores on shallow ones for every phase and depth pair
+ * and writes a parameter file for the player to load.
+ *
+ * Usage: probcutfit collect <log> [positions] [depth] [seed]
+ *        probcutfit fit <log> <probcut file>
+ */
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && !strcmp(argv[1], "collect")) {
+        int positions = (argc > 3) ? atoi(argv[3]) : 100;
+        int depth = (argc > 4) ? atoi(argv[4]) : 10;
+        srand((argc > 5) ? atoi(argv[5]) : 1);
+        return collect(argv[2], positions, depth);
+    }
+    if (argc == 4 && !strcmp(argv[1], "fit")) {
+        return fitLog(argv[2], argv[3]);
+    }
+
+    cerr << "Usage: " << argv[0]
+         << " collect <log> [positions] [depth] [seed]" << endl
+         << "       " << argv[0] << " fit <log> <probcut file>" << endl;
+    return 1;
+}
@@ -0,0 +1,255 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "common.hpp"
+#include "board.hpp"
+#include "eval.hpp"
+#include "gamerecord.hpp"
+#include "samples.hpp"
+using namespace std;
+
+// Games replayed by a thread before it takes more.
+#define CHUNK_GAMES 4096
+
+// Totals for one player name
+struct PlayerTotals {
+    long games;
+    double points;
+    long ms;
+
+    PlayerTotals() : games(0), points(0), ms(0) {}
+};
+
+/*
+ * What replaying some games found, per thread and then summed.
+ */
+struct ReplayTotals {
+    long games;
+    long moves;
+    long passes;
+    long blackWins;
+    long draws;
+    long whiteWins;
+    long forfeits;
+    long illegal;
+    long wrongResults;
+    long blackDiscs;
+    long samples;
+    map<string, PlayerTotals> players;
+
+    ReplayTotals() : games(0), moves(0), passes(0), blackWins(0), draws(0),
+                     whiteWins(0), forfeits(0), illegal(0), wrongResults(0),
+                     blackDiscs(0), samples(0) {}
+
+    void add(const ReplayTotals &t) {
+        games += t.games;
+        moves += t.moves;
+        passes += t.passes;
+        blackWins += t.blackWins;
+        draws += t.draws;
+        whiteWins += t.whiteWins;
+        forfeits += t.forfeits;
+        illegal += t.illegal;
+        wrongResults += t.wrongResults;
+        blackDiscs += t.blackDiscs;
+        samples += t.samples;
+        for (auto &entry : t.players) {
+            PlayerTotals &p = players[entry.first];
+            p.games += entry.second.games;
+            p.points += entry.second.points;
+            p.ms += entry.second.ms;
+        }
+    }
+};
+
+/*
+ * Games shared out between threads in chunks, with the training file (if
+ * any) that the positions of sound games go to.
+ */
+struct Replay {
+    GameArchive archive;
+    vector<size_t> offsets;
+    atomic<size_t> nextChunk;
+    ofstream out;
+    bool writeSamples;
+    mutex lock;
+    ReplayTotals totals;
+
+    // Replays one game, checking its moves and result, and labels its
+    // positions with the final disc difference.
+    void replayGame(const GameRecord &game, ReplayTotals &t,
+                    vector<TrainingSample> &samples) {
+        Board positions[GAME_MAX_MOVES + 1];
+        Side sides[GAME_MAX_MOVES + 1];
+        int played = game.replay(positions, sides);
+
+        t.games++;
+        t.moves += game.moveCount;
+        Side expected = sides[0];
+        for (int i = 0; i < played; i++) {
+            if (sides[i] != expected) t.passes++;
+            expected = opponentOf(sides[i]);
+        }
+
+        const Board &last = positions[played];
+        bool forfeit = game.flags & (GAME_BLACK_FORFEIT | GAME_WHITE_FORFEIT);
+        if (played < game.moveCount) {
+            t.illegal++;
+        } else if (!forfeit &&
+                   (!last.isDone() ||
+                    last.countBlack() - last.countWhite() != game.result)) {
+            t.wrongResults++;
+        }
+
+        // Points for black
+        double points;
+        if (forfeit) {
+            t.forfeits++;
+            points = (game.flags & GAME_BLACK_FORFEIT) ? 0 : 1;
+        } else {
+            points = (game.result > 0) ? 1 : (game.result == 0) ? 0.5 : 0;
+            t.blackDiscs += game.result;
+        }
+        if (points == 1) t.blackWins++;
+        else if (points == 0) t.whiteWins++;
+        else t.draws++;
+
+        PlayerTotals &black = t.players[game.black];
+        black.games++;
+        black.points += points;
+        black.ms += game.blackMs;
+        PlayerTotals &white = t.players[game.white];
+        white.games++;
+        white.points += 1 - points;
+        white.ms += game.whiteMs;
+
+        if (!writeSamples || forfeit || played < game.moveCount) return;
+        for (int i = 0; i < played; i++) {
+            TrainingSample s;
+            s.player = positions[i].getStones(sides[i]);
+            s.opponent = positions[i].getStones(opponentOf(sides[i]));
+            s.score = EVAL_SCALE * ((sides[i] == BLACK) ? game.result
+                                                        : -game.result);
+            s.exact = 0;
+            samples.push_back(s);
+        }
+    }
+
+    void run() {
+        ReplayTotals t;
+        GameRecord game;
+        vector<TrainingSample> samples;
+        size_t chunk;
+        while ((chunk = nextChunk++) * CHUNK_GAMES < offsets.size()) {
+            size_t end = min(offsets.size(), (chunk + 1) * CHUNK_GAMES);
+            samples.clear();
+            for (size_t i = chunk * CHUNK_GAMES; i < end; i++) {
+                size_t offset = offsets[i];
+                archive.read(offset, game);
+                replayGame(game, t, samples);
+            }
+            t.samples += samples.size();
+            if (!samples.empty()) {
+                lock_guard<mutex> guard(lock);
+                out.write((const char *) samples.data(),
+                          samples.size() * sizeof(TrainingSample));
+            }
+        }
+
+        lock_guard<mutex> guard(lock);
+        totals.add(t);
+    }
+};
+
+/*
+ * Replays every game of an archive on several threads, checking that its
+ * moves are legal and its result is right, and prints what the games add up
+ * to: results, lengths, passes and each player's score and thinking time.
+ * With -p the positions of every sound game (not forfeited) also go to a
+ * new training file for evaltrain, labelled with the game's final disc
+ * difference for the side to move. Exits with 1 if any game is unsound.
+ *
+ * Usage: replay [-j threads] [-p training file] <game archive>
+ */
+int main(int argc, char *argv[]) {
+    int threads = thread::hardware_concurrency();
+    const char *samplesPath = nullptr;
+    vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (arg == "-p" && i + 1 < argc) samplesPath = argv[++i];
+        else paths.push_back(argv[i]);
+    }
+    if (paths.size() != 1) {
+        cerr << "Usage: " << argv[0]
+             << " [-j threads] [-p training file] <game archive>" << endl;
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    const char *path = paths[0];
+
+    Replay replay;
+    if (!replay.archive.open(path)) {
+        cerr << "Could not read game archive " << path << endl;
+        return 1;
+    }
+    replay.writeSamples = (samplesPath != nullptr);
+    if (samplesPath) {
+        if (!createSamples(samplesPath, replay.out)) {
+            cerr << "Could not write " << samplesPath << endl;
+            return 1;
+        }
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool complete = replay.archive.index(replay.offsets);
+    if (!complete) {
+        cerr << "Archive ends in a partial game; replaying the "
+             << replay.offsets.size() << " before it" << endl;
+    }
+
+    replay.nextChunk = 0;
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(thread(&Replay::run, &replay));
+    }
+    for (thread &worker : workers) worker.join();
+    double seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+
+    const ReplayTotals &t = replay.totals;
+    long decided = t.games - t.forfeits;
+    cout << fixed << setprecision(1);
+    cout << "Replayed " << t.games << " games, " << t.moves << " moves in "
+         << seconds << " s (" << (seconds > 0 ? t.games / seconds : 0)
+         << " games/s)" << endl;
+    cout << "Black/draw/white: " << t.blackWins << "/" << t.draws << "/"
+         << t.whiteWins << " (" << t.forfeits << " forfeits), black by "
+         << showpos << (decided ? (double) t.blackDiscs / decided : 0)
+         << noshowpos << " discs on average" << endl;
+    cout << "Moves per game: " << (t.games ? (double) t.moves / t.games : 0)
+         << ", passes: " << t.passes << endl;
+    for (auto &entry : t.players) {
+        const PlayerTotals &p = entry.second;
+        cout << entry.first << ": " << p.games << " games, "
+             << 100 * p.points / p.games << "% score, "
+             << p.ms / 1000.0 / p.games << " s per game" << endl;
+    }
+    if (samplesPath) {
+        cout << "Wrote " << t.samples << " positions to " << samplesPath
+             << endl;
+    }
+    cout << "Illegal moves in " << t.illegal << " games, wrong results in "
+         << t.wrongResults << endl;
+    return (t.illegal || t.wrongResults || !complete) ? 1 : 0;
+}
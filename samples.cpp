@@ -0,0 +1,55 @@
+#include <cstring>
+#include "samples.hpp"
+
+// Training file format: the magic bytes and a version, then one
+// TrainingSample per position, appended as games finish.
+#define SAMPLES_MAGIC "OTHS"
+#define SAMPLES_VERSION 1
+
+/*
+ * Starts a new training file, replacing any file at "path", and writes its
+ * header.
+ */
+bool createSamples(const char *path, ofstream &out) {
+    out.open(path, ios::binary | ios::trunc);
+    uint32_t version = SAMPLES_VERSION;
+    out.write(SAMPLES_MAGIC, 4);
+    out.write((const char *) &version, sizeof(version));
+    return (bool) out;
+}
+
+/*
+ * Opens a training file for appending, writing the header if it is new.
+ * Returns false if it cannot be written or holds something else.
+ */
+bool openSamples(const char *path, ofstream &out) {
+    ifstream in(path, ios::binary);
+    if (in) {
+        char magic[4];
+        uint32_t version;
+        in.read(magic, 4);
+        in.read((char *) &version, sizeof(version));
+        if (in) {
+            if (memcmp(magic, SAMPLES_MAGIC, 4) != 0 ||
+                version != SAMPLES_VERSION) {
+                return false;
+            }
+            out.open(path, ios::binary | ios::app);
+            return (bool) out;
+        }
+    }
+    return createSamples(path, out);
+}
+
+/*
+ * Opens a training file for reading, past its header.
+ */
+bool openSamples(const char *path, ifstream &in) {
+    in.open(path, ios::binary);
+    char magic[4];
+    uint32_t version;
+    in.read(magic, 4);
+    in.read((char *) &version, sizeof(version));
+    return in && memcmp(magic, SAMPLES_MAGIC, 4) == 0 &&
+           version == SAMPLES_VERSION;
+}
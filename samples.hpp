@@ -0,0 +1,24 @@
+#ifndef __SAMPLES_H__
+#define __SAMPLES_H__
+
+#include <cstdint>
+#include <fstream>
+using namespace std;
+
+/*
+ * One labelled position of a training file: the side to move's discs, the
+ * opponent's, the label for the side to move in evaluation units, and
+ * whether the label is an exact endgame score.
+ */
+struct TrainingSample {
+    uint64_t player;
+    uint64_t opponent;
+    int32_t score;
+    int32_t exact;
+};
+
+bool createSamples(const char *path, ofstream &out);
+bool openSamples(const char *path, ofstream &out);
+bool openSamples(const char *path, ifstream &in);
+
+#endif
@@ -0,0 +1,390 @@
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.hpp"
+
+/*
+ * Server mode: one process plays any number of games at once, instead of
+ * one process per game. Commands and answers are lines, each about one game
+ * named by an ID of the client's choosing (any word):
+ *
+ *     new <game> <Black|White>       start a game, playing the given side;
+ *                                    answered with "<game> ready"
+ *     move <game> <x> <y> <msLeft>   the opponent's move (-1 -1 for none) and
+ *                                    our time left, as the wrapper takes
+ *                                    them; answered with "<game> move <x> <y>"
+ *                                    (-1 -1 to pass) once searched
+ *     end <game>                     forget the game; answered with
+ *                                    "<game> ended"
+ *
+ * A command that cannot be carried out is answered with "<game> error
+ * <reason>". Answers about different games can come in any order: each game
+ * is searched as soon as a worker is free, so moves of games with little
+ * time left are not held up behind long searches of other games.
+ *
+ * When a client's input ends, its remaining moves are still answered; then
+ * its games are dropped.
+ */
+
+// Table size of each game's player.
+#define SERVER_HASH_MB 16
+
+// Connections waiting to be accepted on the socket.
+#define SERVER_BACKLOG 16
+
+ServerOptions::ServerOptions()
+    : workers(thread::hardware_concurrency()), hashMB(SERVER_HASH_MB) {}
+
+/*
+ * Writes one answer line; answers from different threads do not mix. A
+ * client that went away just does not get it.
+ */
+void ServerClient::send(const string &line) {
+    lock_guard<mutex> guard(writeLock);
+    string text = line + "\n";
+    size_t done = 0;
+    while (done < text.size()) {
+        ssize_t n = write(outFd, text.data() + done, text.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        done += n;
+    }
+}
+
+/*
+ * Reads lines from a file descriptor (a pipe or socket, where a stream
+ * would not do).
+ */
+class LineReader {
+
+private:
+    int fd;
+    string pending;
+
+public:
+    LineReader(int fd) : fd(fd) {}
+
+    bool next(string &line) {
+        size_t end;
+        while ((end = pending.find('\n')) == string::npos) {
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (pending.empty()) return false;
+                line = pending;
+                pending.clear();
+                return true;
+            }
+            pending.append(buffer, n);
+        }
+        line = pending.substr(0, end);
+        pending.erase(0, end + 1);
+        return true;
+    }
+};
+
+/*
+ * Starts the workers. The players of the games all share the tables that
+ * "tables" loads here.
+ */
+GameServer::GameServer(const ServerOptions &options)
+    : options(options), tables(BLACK, nullptr, 1, 1), stopping(false) {
+    int n = (options.workers < 1) ? 1 : options.workers;
+    for (int i = 0; i < n; i++) {
+        workers.push_back(thread(&GameServer::work, this));
+    }
+}
+
+/*
+ * Stops the workers once they finish the searches they are running.
+ */
+GameServer::~GameServer() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (thread &worker : workers) {
+        worker.join();
+    }
+}
+
+/*
+ * Serves one client until its input ends.
+ */
+void GameServer::serve(int inFd, int outFd) {
+    shared_ptr<ServerClient> client = make_shared<ServerClient>(inFd, outFd);
+    LineReader reader(inFd);
+    string line;
+    while (reader.next(line)) {
+        handle(client, line);
+    }
+
+    // Answer what is still queued, then forget the client's games.
+    unique_lock<mutex> guard(lock);
+    idle.wait(guard, [&]() {
+        for (auto &entry : games) {
+            const ServerGame &game = *entry.second;
+            if (game.client == client &&
+                (game.running || !game.requests.empty())) {
+                return false;
+            }
+        }
+        return true;
+    });
+    for (auto it = games.begin(); it != games.end();) {
+        if (it->second->client == client) it = games.erase(it);
+        else ++it;
+    }
+}
+
+void GameServer::handle(shared_ptr<ServerClient> client, const string &line) {
+    stringstream tokens(line);
+    string command, id;
+    if (!(tokens >> command)) return;
+    if (!(tokens >> id)) {
+        client->send("error expected a game after " + command);
+        return;
+    }
+
+    if (command == "new") {
+        string side;
+        tokens >> side;
+        startGame(client, id, side);
+        return;
+    }
+
+    unique_lock<mutex> guard(lock);
+    auto it = games.find(id);
+    if (it == games.end() || it->second->client != client) {
+        guard.unlock();
+        client->send(id + " error unknown game");
+        return;
+    }
+    shared_ptr<ServerGame> game = it->second;
+
+    if (command == "move") {
+        MoveRequest request;
+        if (!(tokens >> request.x >> request.y >> request.msLeft)) {
+            guard.unlock();
+            client->send(id + " error expected x, y and msLeft");
+            return;
+        }
+        request.received = chrono::steady_clock::now();
+        game->requests.push_back(request);
+        guard.unlock();
+        ready.notify_one();
+    }
+    else if (command == "end") {
+        game->ended = true;
+        games.erase(it);
+        guard.unlock();
+        idle.notify_all();
+        client->send(id + " ended");
+    }
+    else {
+        guard.unlock();
+        client->send(id + " error unknown command " + command);
+    }
+}
+
+/*
+ * Sets up a new game. Its player is made outside the lock, as clearing its
+ * table takes a while.
+ */
+void GameServer::startGame(shared_ptr<ServerClient> client, const string &id,
+                           const string &side) {
+    if (side != "Black" && side != "White") {
+        client->send(id + " error expected Black or White");
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        if (games.count(id)) {
+            client->send(id + " error game exists");
+            return;
+        }
+    }
+
+    shared_ptr<ServerGame> game = make_shared<ServerGame>();
+    game->id = id;
+    game->client = client;
+    game->player.reset(new Player(side == "Black" ? BLACK : WHITE, &tables,
+                                  options.hashMB, 1));
+    game->running = false;
+    game->ended = false;
+
+    {
+        lock_guard<mutex> guard(lock);
+        if (games.count(id)) {
+            client->send(id + " error game exists");
+            return;
+        }
+        games[id] = game;
+    }
+    client->send(id + " ready");
+}
+
+/*
+ * The game whose move is due first, among those waiting for a move and not
+ * being searched. A move is due when it arrived plus the time its player
+ * means to spend on it, so games short of time go ahead of games with
+ * plenty, and no game waits long behind the others. Only called with the
+ * lock held.
+ */
+shared_ptr<ServerGame> GameServer::nextGame() {
+    shared_ptr<ServerGame> best;
+    chrono::steady_clock::time_point bestDue;
+    for (auto &entry : games) {
+        ServerGame &game = *entry.second;
+        if (game.running || game.requests.empty()) continue;
+
+        const MoveRequest &request = game.requests.front();
+        chrono::steady_clock::time_point due = request.received;
+        if (request.msLeft >= 0) {
+            due += chrono::milliseconds(game.player->getBudget(
+                &game.player->board, request.msLeft));
+        }
+        if (!best || due < bestDue) {
+            best = entry.second;
+            bestDue = due;
+        }
+    }
+    return best;
+}
+
+/*
+ * A worker: searches one game's move at a time, whichever is due first.
+ */
+void GameServer::work() {
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        shared_ptr<ServerGame> game;
+        ready.wait(guard, [&]() {
+            game = nextGame();
+            return game || stopping;
+        });
+        if (!game) return;
+
+        MoveRequest request = game->requests.front();
+        game->requests.pop_front();
+        game->running = true;
+        guard.unlock();
+
+        // The game's clock ran while the move waited for a worker.
+        int msLeft = request.msLeft;
+        if (msLeft >= 0) {
+            long waited = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - request.received).count();
+            msLeft = (msLeft > waited) ? msLeft - waited : 0;
+        }
+
+        Player *player = game->player.get();
+        string answer;
+        Move opponentsMove(request.x, request.y);
+        bool none = (request.x < 0 || request.y < 0);
+        if (!none && (request.x > 7 || request.y > 7 ||
+                      !player->board.checkMove(&opponentsMove,
+                                               player->opponent_side))) {
+            answer = game->id + " error illegal move";
+        } else {
+            Move *move = player->doMove(none ? nullptr : &opponentsMove,
+                                        msLeft);
+            if (move) {
+                answer = game->id + " move " + to_string(move->getX()) +
+                         " " + to_string(move->getY());
+                delete move;
+            } else {
+                answer = game->id + " move -1 -1";
+            }
+        }
+        // The game stays running until its answer is out, so that a client
+        // whose input ended is not dropped before it gets it.
+        guard.lock();
+        bool ended = game->ended;
+        guard.unlock();
+        if (!ended) {
+            game->client->send(answer);
+        }
+
+        guard.lock();
+        game->running = false;
+        idle.notify_all();
+        if (!game->requests.empty()) {
+            ready.notify_one();
+        }
+    }
+}
+
+/*
+ * Accepts clients on a Unix socket, serving each on its own thread, until
+ * accepting fails. Returns false if the socket cannot be set up.
+ */
+bool GameServer::listen(const string &path) {
+    sockaddr_un address;
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *) &address, sizeof(address)) < 0 ||
+        ::listen(fd, SERVER_BACKLOG) < 0) {
+        close(fd);
+        return false;
+    }
+
+    int client;
+    while ((client = accept(fd, nullptr, nullptr)) >= 0 || errno == EINTR) {
+        if (client < 0) continue;
+        thread([this, client]() {
+            serve(client, client);
+            close(client);
+        }).detach();
+    }
+    close(fd);
+    return true;
+}
+
+/*
+ * The player binary's "serve" mode (argv[1]).
+ */
+int serverMain(int argc, char *argv[]) {
+    ServerOptions options;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) options.workers = atoi(argv[++i]);
+        else if (arg == "-h" && i + 1 < argc) options.hashMB = atoi(argv[++i]);
+        else if (arg == "-s" && i + 1 < argc) options.socketPath = argv[++i];
+        else {
+            cerr << "Usage: " << argv[0] << " serve [-j workers]"
+                 << " [-h hash MB per game] [-s socket]" << endl;
+            return 1;
+        }
+    }
+
+    // Clients that go away must not take the server with them.
+    signal(SIGPIPE, SIG_IGN);
+    // Every game's player would announce itself on stderr.
+    Player::quiet = true;
+
+    GameServer server(options);
+    if (options.socketPath.empty()) {
+        server.serve(0, 1);
+        return 0;
+    }
+    if (!server.listen(options.socketPath)) {
+        cerr << "Could not listen on " << options.socketPath << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "player.hpp"
+using namespace std;
+
+/*
+ * Settings of a game server: how many games search at once, the table size
+ * of each game's player, and the Unix socket to listen on (stdin and stdout
+ * if empty).
+ */
+struct ServerOptions {
+    int workers;
+    int hashMB;
+    string socketPath;
+
+    ServerOptions();
+};
+
+// One connection: commands come in on inFd, answers go out on outFd
+struct ServerClient {
+    int inFd;
+    int outFd;
+    mutex writeLock;
+
+    ServerClient(int inFd, int outFd) : inFd(inFd), outFd(outFd) {}
+    void send(const string &line);
+};
+
+// The opponent's move in one game, waiting for our reply
+struct MoveRequest {
+    int x;
+    int y;
+    int msLeft;
+    chrono::steady_clock::time_point received;
+};
+
+// One game being played, with the player that plays it
+struct ServerGame {
+    string id;
+    shared_ptr<ServerClient> client;
+    unique_ptr<Player> player;
+    deque<MoveRequest> requests;
+    bool running;
+    bool ended;
+};
+
+/*
+ * Plays many games at once in one process. Every game has its own player
+ * (with its own table) but all of them share one set of weights, ProbCut
+ * parameters and opening book, and a fixed pool of worker threads runs their
+ * searches, one game per worker at a time.
+ */
+class GameServer {
+
+private:
+    ServerOptions options;
+    Player tables;
+
+    mutex lock;
+    condition_variable ready;
+    condition_variable idle;
+    map<string, shared_ptr<ServerGame>> games;
+    vector<thread> workers;
+    bool stopping;
+
+    void handle(shared_ptr<ServerClient> client, const string &line);
+    void startGame(shared_ptr<ServerClient> client, const string &id,
+                   const string &side);
+    shared_ptr<ServerGame> nextGame();
+    void work();
+
+public:
+    GameServer(const ServerOptions &options);
+    ~GameServer();
+
+    void serve(int inFd, int outFd);
+    bool listen(const string &path);
+};
+
+int serverMain(int argc, char *argv[]);
+
+#endif
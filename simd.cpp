@@ -0,0 +1,162 @@
+#include "simd.hpp"
+#include "bitboard.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * The level in use, set from what the CPU supports on first use.
+ */
+static SimdLevel &currentLevel() {
+    static SimdLevel level = detectSimd();
+    return level;
+}
+
+/*
+ * The best level the CPU supports.
+ */
+SimdLevel detectSimd() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel getSimdLevel() {
+    return currentLevel();
+}
+
+/*
+ * Switches to a lower level (to test or time the other kernels); levels the
+ * CPU does not support are lowered to the best one it does.
+ */
+void setSimdLevel(SimdLevel level) {
+    SimdLevel best = detectSimd();
+    currentLevel() = (level > best) ? best : level;
+}
+
+const char *simdName(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+#ifdef SIMD_X86
+
+/*
+ * The dumb7fill of movesLeft() and movesRight() on four positions at once,
+ * one per 64-bit lane.
+ */
+template <int dir>
+__attribute__((target("avx2")))
+static inline __m256i movesLeftAvx2(__m256i P, __m256i mask) {
+    __m256i f = _mm256_and_si256(mask, _mm256_slli_epi64(P, dir));
+    for (int i = 0; i < 5; i++) {
+        f = _mm256_or_si256(f, _mm256_and_si256(mask,
+                                                _mm256_slli_epi64(f, dir)));
+    }
+    return _mm256_slli_epi64(f, dir);
+}
+
+template <int dir>
+__attribute__((target("avx2")))
+static inline __m256i movesRightAvx2(__m256i P, __m256i mask) {
+    __m256i f = _mm256_and_si256(mask, _mm256_srli_epi64(P, dir));
+    for (int i = 0; i < 5; i++) {
+        f = _mm256_or_si256(f, _mm256_and_si256(mask,
+                                                _mm256_srli_epi64(f, dir)));
+    }
+    return _mm256_srli_epi64(f, dir);
+}
+
+__attribute__((target("avx2")))
+static void legalMovesAvx2(const uint64_t *P, const uint64_t *O,
+                           uint64_t *moves, int n) {
+    const __m256i innerFiles = _mm256_set1_epi64x(INNER_FILES);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i p = _mm256_loadu_si256((const __m256i *) (P + i));
+        __m256i o = _mm256_loadu_si256((const __m256i *) (O + i));
+        __m256i inner = _mm256_and_si256(o, innerFiles);
+        __m256i m = _mm256_or_si256(movesLeftAvx2<1>(p, inner),
+                                    movesRightAvx2<1>(p, inner));
+        m = _mm256_or_si256(m, movesLeftAvx2<8>(p, o));
+        m = _mm256_or_si256(m, movesRightAvx2<8>(p, o));
+        m = _mm256_or_si256(m, movesLeftAvx2<7>(p, inner));
+        m = _mm256_or_si256(m, movesRightAvx2<7>(p, inner));
+        m = _mm256_or_si256(m, movesLeftAvx2<9>(p, inner));
+        m = _mm256_or_si256(m, movesRightAvx2<9>(p, inner));
+        m = _mm256_andnot_si256(_mm256_or_si256(p, o), m);
+        _mm256_storeu_si256((__m256i *) (moves + i), m);
+    }
+    for (; i < n; i++) moves[i] = legalMoves(P[i], O[i]);
+}
+
+/*
+ * The same on two positions at once; SSE2 is part of every x86-64 CPU.
+ */
+template <int dir>
+__attribute__((target("sse2")))
+static inline __m128i movesLeftSse2(__m128i P, __m128i mask) {
+    __m128i f = _mm_and_si128(mask, _mm_slli_epi64(P, dir));
+    for (int i = 0; i < 5; i++) {
+        f = _mm_or_si128(f, _mm_and_si128(mask, _mm_slli_epi64(f, dir)));
+    }
+    return _mm_slli_epi64(f, dir);
+}
+
+template <int dir>
+__attribute__((target("sse2")))
+static inline __m128i movesRightSse2(__m128i P, __m128i mask) {
+    __m128i f = _mm_and_si128(mask, _mm_srli_epi64(P, dir));
+    for (int i = 0; i < 5; i++) {
+        f = _mm_or_si128(f, _mm_and_si128(mask, _mm_srli_epi64(f, dir)));
+    }
+    return _mm_srli_epi64(f, dir);
+}
+
+__attribute__((target("sse2")))
+static void legalMovesSse2(const uint64_t *P, const uint64_t *O,
+                           uint64_t *moves, int n) {
+    const __m128i innerFiles = _mm_set1_epi64x(INNER_FILES);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i p = _mm_loadu_si128((const __m128i *) (P + i));
+        __m128i o = _mm_loadu_si128((const __m128i *) (O + i));
+        __m128i inner = _mm_and_si128(o, innerFiles);
+        __m128i m = _mm_or_si128(movesLeftSse2<1>(p, inner),
+                                 movesRightSse2<1>(p, inner));
+        m = _mm_or_si128(m, movesLeftSse2<8>(p, o));
+        m = _mm_or_si128(m, movesRightSse2<8>(p, o));
+        m = _mm_or_si128(m, movesLeftSse2<7>(p, inner));
+        m = _mm_or_si128(m, movesRightSse2<7>(p, inner));
+        m = _mm_or_si128(m, movesLeftSse2<9>(p, inner));
+        m = _mm_or_si128(m, movesRightSse2<9>(p, inner));
+        m = _mm_andnot_si128(_mm_or_si128(p, o), m);
+        _mm_storeu_si128((__m128i *) (moves + i), m);
+    }
+    for (; i < n; i++) moves[i] = legalMoves(P[i], O[i]);
+}
+
+#endif
+
+/*
+ * The legal move masks of n positions: moves[i] for P[i] against O[i].
+ */
+void legalMovesBatch(const uint64_t *P, const uint64_t *O, uint64_t *moves,
+                     int n) {
+#ifdef SIMD_X86
+    switch (currentLevel()) {
+        case SIMD_AVX2: legalMovesAvx2(P, O, moves, n); return;
+        case SIMD_SSE2: legalMovesSse2(P, O, moves, n); return;
+        default: break;
+    }
+#endif
+    for (int i = 0; i < n; i++) moves[i] = legalMoves(P[i], O[i]);
+}
@@ -0,0 +1,22 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <cstdint>
+
+/*
+ * Kernels that work on many positions at once, such as all the children of
+ * a node. Each comes in an AVX2, an SSE2 and a plain version; the best one
+ * the CPU supports is picked at run time, the first time one is called, so
+ * the same binary runs everywhere.
+ */
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+SimdLevel detectSimd();
+SimdLevel getSimdLevel();
+void setSimdLevel(SimdLevel level);
+const char *simdName(SimdLevel level);
+
+void legalMovesBatch(const uint64_t *P, const uint64_t *O, uint64_t *moves,
+                     int n);
+
+#endif
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include "common.hpp"
+#include "player.hpp"
+#include "board.hpp"
+
+// Number of heap allocations made since the program started.
+static long allocations = 0;
+
+// Kept out of line so the compiler does not pair the inlined malloc/free
+// against the new/delete expressions at call sites.
+__attribute__((noinline)) void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+// Checks that searching a position does not allocate any memory: move lists
+// live on the stack and moves are made and taken back on a single board.
+int main(int argc, char *argv[]) {
+
+    // A midgame position with moves for both sides.
+    char boardData[64] = {
+        ' ', ' ', 'w', 'w', 'w', ' ', ' ', ' ',
+        ' ', ' ', 'b', 'w', 'b', ' ', ' ', ' ',
+        ' ', 'b', 'b', 'b', 'w', 'b', ' ', ' ',
+        ' ', 'w', 'b', 'w', 'b', 'b', ' ', ' ',
+        ' ', 'w', 'w', 'b', 'w', 'w', 'w', ' ',
+        ' ', ' ', 'w', 'b', 'b', 'w', ' ', ' ',
+        ' ', ' ', ' ', 'b', ' ', ' ', ' ', ' ',
+        ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '
+    };
+    Board *board = new Board();
+    board->setBoard(boardData);
+
+    Player *player = new Player(WHITE);
+    player->testingMinimax = true;
+    player->setThreads(1);
+    player->setBoard(board);
+
+    long before = allocations;
+    MoveList moves = board->getMoves(WHITE);
+    Move move = player->getMinimax(board, moves);
+    long used = allocations - before;
+
+    std::cout << "Searched (" << move.getX() << ", " << move.getY() << ") with "
+              << used << " heap allocations" << std::endl;
+    if (used != 0) {
+        std::cout << "Expected no heap allocations during search" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include "common.hpp"
+#include "board.hpp"
+#include "endgame.hpp"
+#include "analysis.hpp"
+
+#define GAMES 8
+#define DEPTH 4
+
+// Plies after which positions are taken from each game; the last is within
+// exact endgame solving range.
+static const int PLIES[] = { 8, 24, 36, 52 };
+
+// A position and its side to move, as put on an analysis line
+struct Position {
+    Board board;
+    Side side;
+};
+
+static string boardString(const Board &board) {
+    string data(64, '-');
+    for (int i = 0; i < 64; i++) {
+        if (board.getStones(BLACK) & (1ULL << i)) data[i] = 'b';
+        if (board.getStones(WHITE) & (1ULL << i)) data[i] = 'w';
+    }
+    return data;
+}
+
+static string hexString(const Board &board) {
+    char text[33];
+    snprintf(text, sizeof(text), "%016llx%016llx",
+             (unsigned long long) board.getStones(BLACK),
+             (unsigned long long) board.getStones(WHITE));
+    return text;
+}
+
+static vector<string> analyze(const string &input, int workers) {
+    AnalysisOptions options;
+    options.workers = workers;
+    options.depth = DEPTH;
+    options.hashMB = 1;
+
+    stringstream in(input), out;
+    runAnalysis(in, out, options);
+
+    vector<string> lines;
+    string line;
+    while (getline(out, line)) lines.push_back(line);
+    return lines;
+}
+
+static string field(const string &line, const string &name) {
+    stringstream tokens(line);
+    string token;
+    while (tokens >> token) {
+        if (token == name && tokens >> token) return token;
+    }
+    return "";
+}
+
+// Checks that answers come back in input order, the same with any number of
+// workers, for either position encoding, with legal moves and exact endgame
+// scores, and that bad lines get an error without upsetting the rest.
+int main(int argc, char *argv[]) {
+    srand(7);
+    int failures = 0;
+
+    vector<Position> positions;
+    for (int game = 0; game < GAMES; game++) {
+        Board board;
+        Side side = BLACK;
+        unsigned int next = 0;
+        for (int ply = 0; !board.isDone() && next < 4; ply++) {
+            if (ply == PLIES[next]) {
+                positions.push_back(Position{board, side});
+                next++;
+            }
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                Move move = moves[rand() % moves.size()];
+                board.doMove(&move, side);
+            }
+            side = opponentOf(side);
+        }
+    }
+
+    // Every position twice, as 64 characters and as hex, then a bad line;
+    // comments and blank lines in between get no answer.
+    string input = "# analysis test\n\n";
+    for (const Position &pos : positions) {
+        string side = (pos.side == BLACK) ? " b" : " w";
+        input += boardString(pos.board) + side + "\n";
+        input += "   \n";
+        input += hexString(pos.board) + side + "\n";
+    }
+    input += "not-a-position b\n";
+
+    vector<string> single = analyze(input, 1);
+    vector<string> several = analyze(input, 3);
+
+    if (single.size() != 2 * positions.size() + 1) {
+        cerr << "Expected " << 2 * positions.size() + 1 << " answers, got "
+             << single.size() << endl;
+        return 1;
+    }
+    if (several != single) {
+        cerr << "Answers differ between 1 and 3 workers" << endl;
+        failures++;
+    }
+    if (single.back().compare(0, 6, "error ") != 0) {
+        cerr << "No error for a bad line: " << single.back() << endl;
+        failures++;
+    }
+
+    for (unsigned int i = 0; i < positions.size(); i++) {
+        const Position &pos = positions[i];
+        const string &answer = single[2 * i];
+        if (single[2 * i + 1] != answer) {
+            cerr << "Encodings disagree: " << answer << " / "
+                 << single[2 * i + 1] << endl;
+            failures++;
+        }
+
+        string move = field(answer, "move");
+        Move m(move[0] - 'a', move[1] - '1');
+        if (move.size() != 2 || !pos.board.checkMove(&m, pos.side)) {
+            cerr << "Illegal move: " << answer << endl;
+            failures++;
+            continue;
+        }
+
+        int empties = 64 - pos.board.countBlack() - pos.board.countWhite();
+        if (field(answer, "type") == "exact" && empties > 0) {
+            TranspositionTable tt(1);
+            EndgameSolver solver(&tt);
+            int best;
+            int score = solver.solve(pos.board.getStones(pos.side),
+                                     pos.board.getStones(opponentOf(pos.side)),
+                                     -64, 64, best);
+            if (atoi(field(answer, "score").c_str()) != score) {
+                cerr << "Wrong exact score " << answer << ", solved "
+                     << score << endl;
+                failures++;
+            }
+        }
+    }
+
+    cout << positions.size() << " positions, " << failures << " failures"
+         << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include "common.hpp"
+#include "board.hpp"
+#include "book.hpp"
+#include "bitboard.hpp"
+
+#define GAMES 100
+#define BOOK_FILE "testbook.book"
+
+// Checks that book positions are found in every orientation, that other
+// positions are not, and that the book picks the best-scoring move.
+int main(int argc, char *argv[]) {
+    srand(6);
+    int failures = 0;
+
+    // Every other position of some random games goes in the book, with a
+    // score made up from the position itself.
+    vector<BookEntry> entries;
+    vector<BookEntry> inBook, notInBook;
+    for (int game = 0; game < GAMES; game++) {
+        Board board;
+        Side side = BLACK;
+        int ply = 0;
+        while (!board.isDone()) {
+            BookEntry entry;
+            entry.player = board.getStones(side);
+            entry.opponent = board.getStones(opponentOf(side));
+            entry.score = (int32_t) ((entry.player * 31 + entry.opponent) % 1000);
+            entry.count = 1;
+
+            BookEntry key = entry;
+            OpeningBook::canonicalize(key.player, key.opponent);
+            bool seen = false;
+            for (const BookEntry &e : entries) {
+                if (e.player == key.player && e.opponent == key.opponent) {
+                    seen = true;
+                }
+            }
+            if (!seen) {
+                if (ply % 2 == 0) {
+                    entries.push_back(key);
+                    inBook.push_back(entry);
+                } else {
+                    notInBook.push_back(entry);
+                }
+            }
+
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                board.doMove(&moves[rand() % moves.size()], side);
+            }
+            side = opponentOf(side);
+            ply++;
+        }
+    }
+
+    OpeningBook book;
+    if (!OpeningBook::write(BOOK_FILE, entries) || !book.open(BOOK_FILE)) {
+        std::cout << "Could not write and open " << BOOK_FILE << std::endl;
+        remove(BOOK_FILE);
+        return 1;
+    }
+    remove(BOOK_FILE);
+
+    for (const BookEntry &e : inBook) {
+        for (int s = 0; s < 8; s++) {
+            BookEntry found;
+            if (!book.probe(transformBoard(e.player, s),
+                            transformBoard(e.opponent, s), found) ||
+                found.score != e.score) {
+                failures++;
+            }
+        }
+    }
+    for (const BookEntry &e : notInBook) {
+        BookEntry found;
+        if (book.probe(e.player, e.opponent, found)) failures++;
+    }
+    std::cout << book.getSize() << " book positions: " << failures
+              << " wrong lookups of " << 8 * inBook.size() + notInBook.size()
+              << std::endl;
+
+    // A second book with just the replies to a midgame position, with
+    // made-up scores: it should pick the reply worst for the opponent.
+    Board board;
+    Side side = BLACK;
+    for (int ply = 0; ply < 10; ply++) {
+        MoveList moves = board.getMoves(side);
+        board.doMove(&moves[ply % moves.size()], side);
+        side = opponentOf(side);
+    }
+    MoveList moves = board.getMoves(side);
+    vector<BookEntry> replies;
+    int expected = -1;
+    int expectedScore = 0;
+    for (int i = 0; i < moves.size(); i++) {
+        Board child = board;
+        child.doMove(&moves[i], side);
+        BookEntry entry;
+        entry.player = child.getStones(opponentOf(side));
+        entry.opponent = child.getStones(side);
+        OpeningBook::canonicalize(entry.player, entry.opponent);
+        entry.score = (i * 37) % 11 - 5;
+        entry.count = 1;
+        replies.push_back(entry);
+        if (expected < 0 || -entry.score > expectedScore) {
+            expected = moves[i].getSquare();
+            expectedScore = -entry.score;
+        }
+    }
+    if (!OpeningBook::write(BOOK_FILE, replies) || !book.open(BOOK_FILE)) {
+        std::cout << "Could not write and open " << BOOK_FILE << std::endl;
+        remove(BOOK_FILE);
+        return 1;
+    }
+    remove(BOOK_FILE);
+
+    int score;
+    int sq = book.getMove(board.getStones(side),
+                          board.getStones(opponentOf(side)), score);
+    bool ok = (sq == expected && score == expectedScore);
+    if (!ok) failures++;
+    std::cout << (ok ? "Correct" : "Wrong") << " book move " << sq
+              << " with score " << score << ", expected " << expected
+              << " with score " << expectedScore << std::endl;
+
+    // Without one of the replies the book cannot tell which move is best.
+    replies.pop_back();
+    if (!OpeningBook::write(BOOK_FILE, replies) || !book.open(BOOK_FILE)) {
+        std::cout << "Could not write and open " << BOOK_FILE << std::endl;
+        remove(BOOK_FILE);
+        return 1;
+    }
+    remove(BOOK_FILE);
+    sq = book.getMove(board.getStones(side), board.getStones(opponentOf(side)),
+                      score);
+    if (sq >= 0) failures++;
+    std::cout << "Book move with a reply missing: " << sq << ", expected -1"
+              << std::endl;
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+#include <iostream>
+#include <cstdlib>
+#include "common.hpp"
+#include "board.hpp"
+#include "endgame.hpp"
+#include "ttable.hpp"
+
+#define POSITIONS 40
+#define EMPTIES 10
+
+/*
+ * Plain negamax to the end of the game on the Board class: the final disc
+ * difference for the side to move, empties going to the winner.
+ */
+static int minimax(Board *b, Side side, bool passed) {
+    MoveList moves = b->getMoves(side);
+    if (moves.empty()) {
+        if (passed) {
+            int diff = b->count(side) - b->count(opponentOf(side));
+            int empties = 64 - b->countBlack() - b->countWhite();
+            if (diff > 0) return diff + empties;
+            if (diff < 0) return diff - empties;
+            return 0;
+        }
+        return -minimax(b, opponentOf(side), true);
+    }
+
+    int best = -65;
+    for (int i = 0; i < moves.size(); i++) {
+        uint64_t flipped = b->doMove(&moves[i], side);
+        int score = -minimax(b, opponentOf(side), false);
+        b->undoMove(&moves[i], flipped, side);
+        if (score > best) best = score;
+    }
+    return best;
+}
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+// Checks the endgame solver against plain minimax on positions from random
+// games, both for the exact score and for win/loss/draw.
+int main(int argc, char *argv[]) {
+    srand(2);
+    TranspositionTable tt(16);
+    int failures = 0;
+    int tested = 0;
+
+    while (tested < POSITIONS) {
+        // Play randomly until EMPTIES squares are left.
+        Board board;
+        Side side = BLACK;
+        while (64 - board.countBlack() - board.countWhite() > EMPTIES &&
+               !board.isDone()) {
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                board.doMove(&moves[rand() % moves.size()], side);
+            }
+            side = opponentOf(side);
+        }
+        if (board.isDone()) continue;
+        tested++;
+
+        int expected = minimax(&board, side, false);
+
+        EndgameSolver solver(&tt);
+        int move;
+        int exact = solver.solve(board.getStones(side),
+                                 board.getStones(opponentOf(side)), -64, 64,
+                                 move);
+        int wld = solver.solve(board.getStones(side),
+                               board.getStones(opponentOf(side)), -1, 1, move);
+
+        if (exact != expected || sign(wld) != sign(expected)) {
+            failures++;
+            std::cout << "Position " << tested << ": solver " << exact
+                      << " (win/loss/draw " << wld << "), expected "
+                      << expected << std::endl;
+        }
+    }
+
+    std::cout << tested - failures << " of " << tested
+              << " endgames solved correctly" << std::endl;
+    return failures ? 1 : 0;
+}
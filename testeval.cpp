@@ -0,0 +1,262 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include "common.hpp"
+#include "board.hpp"
+#include "eval.hpp"
+#include "simd.hpp"
+
+#define GAMES 200
+#define WEIGHTS_FILE "testeval.weights"
+
+/*
+ * Image of a bitboard under one of the 8 board symmetries.
+ */
+static uint64_t transform(uint64_t b, int s) {
+    uint64_t result = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (!((b >> sq) & 1)) continue;
+        int x = sq & 7, y = sq >> 3;
+        if (s & 1) x = 7 - x;
+        if (s & 2) y = 7 - y;
+        result |= 1ULL << ((s & 4) ? y + 8 * x : x + 8 * y);
+    }
+    return result;
+}
+
+/*
+ * Plays random games and checks every position scores the same as its
+ * symmetric images, and as with a second evaluation (if given).
+ */
+static int check(PatternEval &eval, PatternEval *copy, const char *name) {
+    srand(3);
+    int failures = 0;
+    long positions = 0;
+    for (int game = 0; game < GAMES; game++) {
+        Board board;
+        Side side = BLACK;
+        while (!board.isDone()) {
+            uint64_t P = board.getStones(side);
+            uint64_t O = board.getStones(opponentOf(side));
+            int score = eval.evaluate(P, O);
+            positions++;
+            for (int s = 1; s < 8; s++) {
+                if (eval.evaluate(transform(P, s), transform(O, s)) != score) {
+                    failures++;
+                }
+            }
+            if (copy && copy->evaluate(P, O) != score) failures++;
+
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                board.doMove(&moves[rand() % moves.size()], side);
+            }
+            side = opponentOf(side);
+        }
+    }
+    std::cout << name << ": " << failures << " mismatches in " << positions
+              << " positions" << std::endl;
+    return failures;
+}
+
+/*
+ * Plays random games and checks that the pattern indices a BoardState keeps
+ * up to date through doMove() and undoMove() give the same scores, for both
+ * sides, as working them out from scratch, that they are the indices
+ * getIndices() gives, and that its hash matches too.
+ */
+static int checkIncremental(PatternEval &eval) {
+    srand(5);
+    int failures = 0;
+    long positions = 0;
+    for (int game = 0; game < GAMES; game++) {
+        Board board;
+        BoardState state;
+        state.set(board);
+        Side side = BLACK;
+        while (!board.isDone()) {
+            for (int s = 0; s < 2; s++) {
+                Side who = s ? WHITE : BLACK;
+                int full = eval.evaluate(board.getStones(who),
+                                         board.getStones(opponentOf(who)));
+                if (eval.evaluate(state.patterns, board.getStones(who),
+                                  board.getStones(opponentOf(who)),
+                                  who) != full ||
+                    state.getHash(who) != board.getHash(who)) {
+                    failures++;
+                }
+            }
+            int indices[PATTERN_INSTANCES];
+            PatternEval::getIndices(board.getStones(BLACK),
+                                    board.getStones(WHITE), indices);
+            for (int i = 0; i < PATTERN_INSTANCES; i++) {
+                if (indices[i] != state.patterns[i]) failures++;
+            }
+            positions++;
+
+            // Try every move and take it back before playing a random one
+            MoveList moves = board.getMoves(side);
+            uint64_t P = board.getStones(side);
+            uint64_t O = board.getStones(opponentOf(side));
+            int before = eval.evaluate(state.patterns, P, O, side);
+            for (int i = 0; i < moves.size(); i++) {
+                int sq = moves[i].getSquare();
+                uint64_t flipped = board.doMove(&moves[i], side);
+                state.doMove(flipped, sq, side);
+                if (eval.evaluate(state.patterns, board.getStones(side),
+                                  board.getStones(opponentOf(side)), side) !=
+                    eval.evaluate(board.getStones(side),
+                                  board.getStones(opponentOf(side)))) {
+                    failures++;
+                }
+                board.undoMove(&moves[i], flipped, side);
+                state.undoMove(flipped, sq, side);
+                if (eval.evaluate(state.patterns, P, O, side) != before) {
+                    failures++;
+                }
+            }
+            if (!moves.empty()) {
+                Move &m = moves[rand() % moves.size()];
+                state.doMove(board.doMove(&m, side), m.getSquare(), side);
+            }
+            side = opponentOf(side);
+        }
+    }
+    std::cout << "Incremental indices: " << failures << " mismatches in "
+              << positions << " positions" << std::endl;
+    return failures;
+}
+
+/*
+ * Checks the bitboard terms along random games: the mobility against the move
+ * list, and that no disc counted as stable is ever flipped in the rest of the
+ * game.
+ */
+static int checkFeatures() {
+    srand(6);
+    int failures = 0;
+    long stable = 0;
+    for (int game = 0; game < GAMES; game++) {
+        Board board;
+        Side side = BLACK;
+        uint64_t stableDiscs[2] = {0, 0};
+        while (!board.isDone()) {
+            for (int s = 0; s < 2; s++) {
+                Side who = s ? WHITE : BLACK;
+                if (board.getMobility(who) != board.getMoves(who).size()) {
+                    failures++;
+                }
+                uint64_t discs = board.getStableDiscs(who);
+                if ((discs & ~board.getStones(who)) ||
+                    (stableDiscs[s] & ~discs)) {
+                    failures++;
+                }
+                stableDiscs[s] = discs;
+            }
+
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                Move &m = moves[rand() % moves.size()];
+                board.doMove(&m, side);
+            }
+            side = opponentOf(side);
+        }
+        stable += __builtin_popcountll(stableDiscs[0] | stableDiscs[1]);
+    }
+    std::cout << "Mobility and stability: " << failures << " mismatches, "
+              << stable << " discs stable at the end of " << GAMES
+              << " games" << std::endl;
+    return failures;
+}
+
+/*
+ * Checks that batch evaluation and move generation give what the one-at-a-
+ * time versions do, with every SIMD level the CPU supports, on the positions
+ * of random games in batches of every size up to 70 (past a full block, so
+ * that the kernels' leftover lanes are used too).
+ */
+static int checkBatch(PatternEval &eval) {
+    srand(7);
+    vector<uint64_t> P, O;
+    for (int game = 0; game < 20; game++) {
+        Board board;
+        Side side = BLACK;
+        while (!board.isDone()) {
+            P.push_back(board.getStones(side));
+            O.push_back(board.getStones(opponentOf(side)));
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                board.doMove(&moves[rand() % moves.size()], side);
+            }
+            side = opponentOf(side);
+        }
+    }
+
+    int failures = 0;
+    SimdLevel best = getSimdLevel();
+    for (int level = SIMD_SCALAR; level <= best; level++) {
+        setSimdLevel((SimdLevel) level);
+        int levelFailures = 0;
+        for (size_t start = 0; start < P.size(); ) {
+            int n = 1 + (int) (start % 70);
+            if (start + n > P.size()) n = P.size() - start;
+            int scores[70];
+            uint64_t moves[70];
+            eval.evaluateBatch(&P[start], &O[start], scores, n);
+            legalMovesBatch(&P[start], &O[start], moves, n);
+            for (int i = 0; i < n; i++) {
+                if (scores[i] != eval.evaluate(P[start + i], O[start + i]) ||
+                    moves[i] != legalMoves(P[start + i], O[start + i])) {
+                    levelFailures++;
+                }
+            }
+            start += n;
+        }
+        std::cout << "Batch evaluation (" << simdName((SimdLevel) level)
+                  << "): " << levelFailures << " mismatches in " << P.size()
+                  << " positions" << std::endl;
+        failures += levelFailures;
+    }
+    setSimdLevel(best);
+    return failures;
+}
+
+// Checks that the pattern evaluation is symmetric, with the default weights
+// and with random ones, that weights survive a save and load, that the
+// incrementally updated indices match a full recompute, that the mobility
+// and stability terms are sound, and that batches score the same.
+int main(int argc, char *argv[]) {
+    int failures = 0;
+
+    PatternEval eval;
+    failures += check(eval, nullptr, "Default weights");
+
+    srand(4);
+    for (int phase = 0; phase < EVAL_PHASES; phase++) {
+        for (int t = 0; t < PATTERN_TYPES; t++) {
+            int16_t *w = eval.table(phase, t);
+            int entries = 1;
+            for (int k = 0; k < PatternEval::typeSize(t); k++) entries *= 3;
+            for (int i = 0; i < entries; i++) {
+                w[i] = rand() % 201 - 100;
+            }
+        }
+        for (int f = 0; f < EVAL_FEATURES; f++) {
+            eval.features(phase)[f] = rand() % 201 - 100;
+        }
+    }
+    eval.symmetrize();
+
+    PatternEval loaded;
+    if (!eval.save(WEIGHTS_FILE) || !loaded.load(WEIGHTS_FILE)) {
+        std::cout << "Could not save and load " << WEIGHTS_FILE << std::endl;
+        failures++;
+    }
+    remove(WEIGHTS_FILE);
+    failures += check(eval, &loaded, "Random weights");
+    failures += checkIncremental(eval);
+    failures += checkFeatures();
+    failures += checkBatch(eval);
+
+    return failures ? 1 : 0;
+}
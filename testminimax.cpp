@@ -25,6 +25,7 @@ int main(int argc, char *argv[]) {
     // Initialize player as the white player, and set testing_minimax flag.
     Player *player = new Player(WHITE);
     player->testingMinimax = true;
+    player->maxDepth = 2;
 
 
     /**
@@ -37,14 +38,14 @@ int main(int argc, char *argv[]) {
     // Get player's move and check if it's right.
     Move *move = player->doMove(nullptr, 0);
 
-    if (move != nullptr && move->x == 1 && move->y == 1) {
+    if (move != nullptr && move->getX() == 1 && move->getY() == 1) {
         std::cout << "Correct move: (1, 1)" << std::endl;;
     } else {
         std::cout << "Wrong move: got ";
         if (move == nullptr) {
             std::cout << "PASS";
         } else {
-            std::cout << "(" << move->x << ", " << move->y << ")";
+            std::cout << "(" << move->getX() << ", " << move->getY() << ")";
         }
         std::cout << ", expected (1, 1)" << std::endl;
     }
@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include "common.hpp"
+#include "board.hpp"
+#include "player.hpp"
+#include "probcut.hpp"
+
+#define POSITIONS 20
+#define DEPTH 9
+#define SELECTIVITY 3
+#define PARAMS_FILE "testprobcut.probcut"
+
+// Share (in percent) of positions where the selective search must still find
+// the full-width search's move.
+#define MIN_AGREEMENT 75
+
+/*
+ * Searches the position to DEPTH at the given selectivity level and returns
+ * the chosen square, adding the nodes searched to "nodes".
+ */
+static int search(Board &board, Side side, int selectivity, long &nodes) {
+    Player *player = new Player(side);
+    player->maxDepth = DEPTH;
+    player->selectivity = selectivity;
+    player->setThreads(1);
+    player->setBoard(&board);
+
+    Move *move = player->doMove(nullptr, -1);
+    int sq = move->getSquare();
+    nodes += player->nodes;
+
+    delete move;
+    delete player;
+    return sq;
+}
+
+// Checks that ProbCut parameters survive a save and load, and that selective
+// search cuts the tree down while mostly finding the same moves.
+int main(int argc, char *argv[]) {
+    srand(16);
+    int failures = 0;
+
+    ProbCut saved, loaded;
+    ProbCutCheck *check = saved.getChecks(3, 7);
+    check[1].a = 0.9f;
+    check[1].b = -12;
+    check[1].sigma = 321;
+    if (!saved.save(PARAMS_FILE) || !loaded.load(PARAMS_FILE)) {
+        std::cout << "Could not write and load " << PARAMS_FILE << std::endl;
+        remove(PARAMS_FILE);
+        return 1;
+    }
+    remove(PARAMS_FILE);
+    ProbCutCheck *back = loaded.getChecks(3, 7);
+    if (back[1].shallow != check[1].shallow || back[1].a != check[1].a ||
+        back[1].b != check[1].b || back[1].sigma != check[1].sigma) {
+        std::cout << "Parameters changed in a save and load" << std::endl;
+        failures++;
+    }
+
+    // Midgame positions from random games
+    long fullNodes = 0, selectiveNodes = 0;
+    int agree = 0;
+    for (int i = 0; i < POSITIONS; i++) {
+        Board board;
+        Side side = BLACK;
+        int plies = 12 + rand() % 20;
+        for (int ply = 0; ply < plies && !board.isDone(); ply++) {
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                board.doMove(&moves[rand() % moves.size()], side);
+            }
+            side = opponentOf(side);
+        }
+        if (!board.hasMoves(side)) {
+            i--;
+            continue;
+        }
+
+        Board full = board, selective = board;
+        int fullMove = search(full, side, 0, fullNodes);
+        int selectiveMove = search(selective, side, SELECTIVITY,
+                                   selectiveNodes);
+        if (fullMove == selectiveMove) agree++;
+    }
+
+    std::cout << "Selective search: " << selectiveNodes << " nodes, "
+              << "full width: " << fullNodes << " nodes; same move in "
+              << agree << " of " << POSITIONS << " positions" << std::endl;
+    if (selectiveNodes >= fullNodes) {
+        std::cout << "Selective search did not save nodes" << std::endl;
+        failures++;
+    }
+    if (agree * 100 < MIN_AGREEMENT * POSITIONS) {
+        std::cout << "Selective search found too few of the same moves"
+                  << std::endl;
+        failures++;
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include "common.hpp"
+#include "board.hpp"
+#include "gamerecord.hpp"
+
+#define GAMES 200
+#define ARCHIVE_FILE "testrecord.games"
+#define TRUNCATED_FILE "testrecord.truncated"
+
+/*
+ * Plays a random game, every few from a position some random moves in, and
+ * keeps the positions it went through (before each move, then the last).
+ */
+static GameRecord randomGame(int game, vector<Board> &positions) {
+    GameRecord record;
+    record.black = "black" + to_string(game % 3);
+    record.white = (game % 5 == 0) ? string(300, 'w') : "white";
+    record.blackMs = rand() % 100000;
+    record.whiteMs = rand() % 100000;
+
+    Board board;
+    Side side = BLACK;
+    if (game % 4 == 0) {
+        int plies = 4 + rand() % 20;
+        for (int i = 0; i < plies && !board.isDone(); i++) {
+            MoveList moves = board.getMoves(side);
+            if (!moves.empty()) {
+                Move move = moves[rand() % moves.size()];
+                board.doMove(&move, side);
+            }
+            side = opponentOf(side);
+        }
+        record.flags |= GAME_START_GIVEN;
+        if (side == WHITE) record.flags |= GAME_WHITE_FIRST;
+        record.startBlack = board.getStones(BLACK);
+        record.startWhite = board.getStones(WHITE);
+    }
+
+    positions.clear();
+    while (!board.isDone()) {
+        MoveList moves = board.getMoves(side);
+        if (!moves.empty()) {
+            positions.push_back(board);
+            Move move = moves[rand() % moves.size()];
+            board.doMove(&move, side);
+            record.moves[record.moveCount++] = move.getSquare();
+        }
+        side = opponentOf(side);
+    }
+    positions.push_back(board);
+    record.result = board.countBlack() - board.countWhite();
+    if (game % 7 == 0) record.flags |= GAME_WHITE_FORFEIT;
+    return record;
+}
+
+static bool sameGame(const GameRecord &a, const GameRecord &b) {
+    // Names are cut to 255 characters
+    if (a.black != b.black.substr(0, 255) ||
+        a.white != b.white.substr(0, 255) || a.flags != b.flags ||
+        a.result != b.result ||
+        a.blackMs != b.blackMs || a.whiteMs != b.whiteMs ||
+        a.startBlack != b.startBlack || a.startWhite != b.startWhite ||
+        a.moveCount != b.moveCount) {
+        return false;
+    }
+    for (int i = 0; i < a.moveCount; i++) {
+        if (a.moves[i] != b.moves[i]) return false;
+    }
+    return true;
+}
+
+// Checks that games written to an archive read back the same, in two
+// sessions of appending, that they replay through the same positions, and
+// that an archive cut short is noticed.
+int main(int argc, char *argv[]) {
+    srand(8);
+    remove(ARCHIVE_FILE);
+    int failures = 0;
+
+    vector<GameRecord> games;
+    vector<vector<Board>> positions(GAMES);
+    GameWriter writer;
+    for (int game = 0; game < GAMES; game++) {
+        // Close and reopen halfway, to append to an existing archive
+        if (game == 0 || game == GAMES / 2) {
+            if (!writer.open(ARCHIVE_FILE)) {
+                cerr << "Could not open " << ARCHIVE_FILE << endl;
+                return 1;
+            }
+        }
+        games.push_back(randomGame(game, positions[game]));
+        if (!writer.write(games.back())) failures++;
+        if (game == GAMES / 2 - 1) writer.close();
+    }
+    writer.close();
+
+    GameArchive archive;
+    if (!archive.open(ARCHIVE_FILE)) {
+        cerr << "Could not read " << ARCHIVE_FILE << endl;
+        return 1;
+    }
+
+    vector<size_t> offsets;
+    if (!archive.index(offsets) || offsets.size() != GAMES) {
+        cerr << "Indexed " << offsets.size() << " of " << GAMES << " games"
+             << endl;
+        failures++;
+    }
+
+    size_t offset = archive.begin();
+    GameRecord game;
+    int read = 0;
+    int wrongPositions = 0;
+    size_t start = offset;
+    while (archive.read(offset, game)) {
+        if (read >= GAMES || offsets[read] != start ||
+            !sameGame(game, games[read])) {
+            failures++;
+        }
+        start = offset;
+
+        Board replayed[GAME_MAX_MOVES + 1];
+        Side sides[GAME_MAX_MOVES + 1];
+        int played = game.replay(replayed, sides);
+        if (played != game.moveCount) failures++;
+        for (int i = 0; i <= played && read < GAMES; i++) {
+            const Board &expected = positions[read][i];
+            if (replayed[i].getStones(BLACK) != expected.getStones(BLACK) ||
+                replayed[i].getStones(WHITE) != expected.getStones(WHITE)) {
+                wrongPositions++;
+            }
+        }
+        read++;
+    }
+    if (read != GAMES || offset != archive.end()) {
+        cerr << "Read " << read << " of " << GAMES << " games" << endl;
+        failures++;
+    }
+    archive.close();
+
+    // An archive missing the end of its last game
+    ifstream in(ARCHIVE_FILE, ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    ofstream out(TRUNCATED_FILE, ios::binary | ios::trunc);
+    out.write(data.data(), data.size() - 3);
+    out.close();
+    if (!archive.open(TRUNCATED_FILE) || archive.index(offsets) ||
+        offsets.size() != GAMES - 1) {
+        cerr << "Truncated archive not noticed" << endl;
+        failures++;
+    }
+    archive.close();
+    remove(ARCHIVE_FILE);
+    remove(TRUNCATED_FILE);
+
+    cout << read << " games read back: " << failures << " failures, "
+         << wrongPositions << " wrong positions" << endl;
+    return (failures || wrongPositions) ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "common.hpp"
+#include "board.hpp"
+#include "server.hpp"
+
+// Games played against each other through one server, and the time each
+// side says it has left for every move.
+#define PAIRS 3
+#define MS_LEFT 400
+
+// Two of the server's games playing each other, with the board between them
+struct Pair {
+    string black;
+    string white;
+    Board board;
+    Side toMove;
+    bool done;
+};
+
+static void send(int fd, const string &line) {
+    string text = line + "\n";
+    if (write(fd, text.data(), text.size()) != (ssize_t) text.size()) {
+        cerr << "Could not send " << line << endl;
+    }
+}
+
+static string receive(FILE *in) {
+    char line[256];
+    if (!fgets(line, sizeof(line), in)) return "";
+    line[strcspn(line, "\n")] = '\0';
+    return line;
+}
+
+static int expect(FILE *in, const string &answer) {
+    string line = receive(in);
+    if (line == answer) return 0;
+    cerr << "Expected \"" << answer << "\", got \"" << line << "\"" << endl;
+    return 1;
+}
+
+// Checks that a server plays several games at once to the end with legal
+// moves only, and that it turns down commands it cannot carry out.
+int main(int argc, char *argv[]) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        cerr << "Could not make a socket pair" << endl;
+        return 1;
+    }
+
+    ServerOptions options;
+    options.workers = 2;
+    options.hashMB = 1;
+    GameServer *server = new GameServer(options);
+    thread serving([&]() { server->serve(fds[1], fds[1]); });
+
+    FILE *in = fdopen(fds[0], "r");
+    int failures = 0;
+
+    // Commands that must be turned down
+    send(fds[0], "new x Black");
+    failures += expect(in, "x ready");
+    send(fds[0], "new x White");
+    failures += expect(in, "x error game exists");
+    send(fds[0], "move x 0 0 1000");
+    failures += expect(in, "x error illegal move");
+    send(fds[0], "move y -1 -1 1000");
+    failures += expect(in, "y error unknown game");
+    send(fds[0], "undo x");
+    failures += expect(in, "x error unknown command undo");
+    send(fds[0], "end x");
+    failures += expect(in, "x ended");
+
+    vector<Pair> pairs(PAIRS);
+    for (int i = 0; i < PAIRS; i++) {
+        Pair &pair = pairs[i];
+        pair.black = "b" + to_string(i);
+        pair.white = "w" + to_string(i);
+        pair.toMove = BLACK;
+        pair.done = false;
+        send(fds[0], "new " + pair.black + " Black");
+        failures += expect(in, pair.black + " ready");
+        send(fds[0], "new " + pair.white + " White");
+        failures += expect(in, pair.white + " ready");
+    }
+
+    // Start every game, then pass each move on to the other side's game.
+    for (Pair &pair : pairs) {
+        send(fds[0], "move " + pair.black + " -1 -1 " + to_string(MS_LEFT));
+    }
+    int moves = 0;
+    int playing = PAIRS;
+    while (playing > 0 && failures == 0) {
+        string line = receive(in);
+        stringstream tokens(line);
+        string id, word;
+        int x, y;
+        if (!(tokens >> id >> word >> x >> y) || word != "move") {
+            cerr << "Unexpected answer \"" << line << "\"" << endl;
+            failures++;
+            break;
+        }
+
+        Pair *pair = nullptr;
+        for (Pair &p : pairs) {
+            string mover = (p.toMove == BLACK) ? p.black : p.white;
+            if (mover == id && !p.done) pair = &p;
+        }
+        if (!pair) {
+            cerr << "Answer from a game not to move: " << line << endl;
+            failures++;
+            break;
+        }
+
+        Move move(x, y);
+        if (x < 0) {
+            if (pair->board.hasMoves(pair->toMove)) {
+                cerr << id << " passed with moves left" << endl;
+                failures++;
+            }
+        } else if (!pair->board.checkMove(&move, pair->toMove)) {
+            cerr << id << " played an illegal move: " << line << endl;
+            failures++;
+        } else {
+            pair->board.doMove(&move, pair->toMove);
+            moves++;
+        }
+        pair->toMove = opponentOf(pair->toMove);
+
+        if (pair->board.isDone()) {
+            pair->done = true;
+            playing--;
+            continue;
+        }
+        string next = (pair->toMove == BLACK) ? pair->black : pair->white;
+        send(fds[0], "move " + next + " " + to_string(x) + " " +
+                     to_string(y) + " " + to_string(MS_LEFT));
+    }
+
+    for (Pair &pair : pairs) {
+        send(fds[0], "end " + pair.black);
+        failures += expect(in, pair.black + " ended");
+        send(fds[0], "end " + pair.white);
+        failures += expect(in, pair.white + " ended");
+    }
+
+    shutdown(fds[0], SHUT_WR);
+    serving.join();
+    delete server;
+    fclose(in);
+    close(fds[1]);
+
+    cout << PAIRS << " games, " << moves << " moves, " << failures
+         << " failures" << endl;
+    return failures ? 1 : 0;
+}
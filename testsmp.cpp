@@ -0,0 +1,92 @@
+#include <iostream>
+#include "common.hpp"
+#include "player.hpp"
+#include "board.hpp"
+
+// Positions to search, with the side to move.
+struct TestPosition {
+    const char *data;
+    Side side;
+};
+
+static const TestPosition POSITIONS[] = {
+    { "-wbb----"
+      "-wb-----"
+      "-bbwwww-"
+      "-bbbbb--"
+      "--bwbb--"
+      "--www---"
+      "--b-----"
+      "--------", BLACK },
+    { "--------"
+      "bwwww--w"
+      "-wwwbbww"
+      "wwbwwwbw"
+      "ww-bwbbw"
+      "--bw-ww-"
+      "---wwww-"
+      "--------", BLACK },
+    { "----w---"
+      "---wbw-b"
+      "-wwwb-b-"
+      "-bbbbbbw"
+      "--bwb-b-"
+      "--wwbbbw"
+      "-wwwbbbb"
+      "-wwwwwww", WHITE },
+};
+
+#define DEPTH 7
+#define RUNS 3
+
+/*
+ * Searches a position to a fixed depth with the given number of threads and
+ * returns the chosen move, with its score in "score".
+ */
+static Move search(const TestPosition &pos, int threads, int &score) {
+    Board *board = new Board();
+    board->setBoard(pos.data);
+
+    Player *player = new Player(pos.side);
+    player->maxDepth = DEPTH;
+    player->selectivity = 0;
+    player->setThreads(threads);
+    player->setBoard(board);
+
+    Move *move = player->doMove(nullptr, -1);
+    Move result = *move;
+    score = player->lastScore;
+
+    delete move;
+    delete player;
+    delete board;
+    return result;
+}
+
+// Checks that a fixed-depth, full-width search picks the same move with the
+// same score no matter how many threads search it.
+int main(int argc, char *argv[]) {
+    int failures = 0;
+
+    for (const TestPosition &pos : POSITIONS) {
+        int expectedScore;
+        Move expected = search(pos, 1, expectedScore);
+
+        for (int run = 0; run < RUNS; run++) {
+            int threads = 2 + 2 * run;
+            int score;
+            Move move = search(pos, threads, score);
+
+            bool ok = (move.getSquare() == expected.getSquare() &&
+                       score == expectedScore);
+            if (!ok) failures++;
+            std::cout << (ok ? "Same" : "Different") << " result with "
+                      << threads << " threads: (" << move.getX() << ", "
+                      << move.getY() << ") score " << score << ", expected ("
+                      << expected.getX() << ", " << expected.getY()
+                      << ") score " << expectedScore << std::endl;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+#include "ttable.hpp"
+
+// Layout of the packed data word: score in the low 32 bits, then depth,
+// bound, best move (0xff for none) and age, one byte each.
+static inline uint64_t pack(int score, int depth, Bound bound, int move,
+                            uint8_t age) {
+    return (uint64_t) (uint32_t) score
+         | (uint64_t) (uint8_t) depth << 32
+         | (uint64_t) bound << 40
+         | (uint64_t) (uint8_t) (move < 0 ? 0xff : move) << 48
+         | (uint64_t) age << 56;
+}
+
+static inline int dataScore(uint64_t data) { return (int32_t) data; }
+static inline int dataDepth(uint64_t data) { return (int8_t) (data >> 32); }
+static inline Bound dataBound(uint64_t data) {
+    return (Bound) ((data >> 40) & 0xff);
+}
+static inline int dataMove(uint64_t data) {
+    int move = (data >> 48) & 0xff;
+    return (move == 0xff) ? -1 : move;
+}
+static inline uint8_t dataAge(uint64_t data) { return data >> 56; }
+
+/*
+ * Make a table that uses (at most) the given number of megabytes.
+ */
+TranspositionTable::TranspositionTable(int sizeMB) {
+    buckets = nullptr;
+    age = 0;
+    resize(sizeMB);
+}
+
+/*
+ * Destructor for the table.
+ */
+TranspositionTable::~TranspositionTable() {
+    delete[] buckets;
+}
+
+/*
+ * Reallocates the table to the largest power-of-two number of buckets that
+ * fits in the given number of megabytes. All entries are lost.
+ */
+void TranspositionTable::resize(int sizeMB) {
+    uint64_t bytes = (uint64_t) (sizeMB > 0 ? sizeMB : 1) << 20;
+    uint64_t count = 1;
+    while (count * 2 * sizeof(TTBucket) <= bytes) count *= 2;
+
+    delete[] buckets;
+    buckets = new TTBucket[count];
+    mask = count - 1;
+    clear();
+}
+
+/*
+ * Forgets every stored result.
+ */
+void TranspositionTable::clear() {
+    for (uint64_t i = 0; i <= mask; i++) {
+        for (TTSlot &slot : buckets[i].slots) {
+            slot.check.store(0, memory_order_relaxed);
+            slot.data.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+/*
+ * Marks the start of a new search, so entries from earlier ones become
+ * cheaper to replace.
+ */
+void TranspositionTable::newSearch() {
+    age++;
+}
+
+/*
+ * Looks up a position. Returns true and fills in the entry if it is stored.
+ */
+bool TranspositionTable::probe(uint64_t key, TTEntry &entry) {
+    TTBucket &bucket = buckets[key & mask];
+    for (TTSlot &slot : bucket.slots) {
+        uint64_t data = slot.data.load(memory_order_relaxed);
+        uint64_t check = slot.check.load(memory_order_relaxed);
+        if ((check ^ data) == key && dataBound(data) != BOUND_NONE) {
+            entry.score = dataScore(data);
+            entry.depth = dataDepth(data);
+            entry.bound = dataBound(data);
+            entry.move = dataMove(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Stores a search result, overwriting the entry for the same position if
+ * there is one, otherwise an empty entry or the least valuable one.
+ */
+void TranspositionTable::store(uint64_t key, int depth, int score,
+                               Bound bound, int move) {
+    TTBucket &bucket = buckets[key & mask];
+    TTSlot *replace = &bucket.slots[0];
+    int worst = 1 << 30;
+    for (TTSlot &slot : bucket.slots) {
+        uint64_t data = slot.data.load(memory_order_relaxed);
+        uint64_t check = slot.check.load(memory_order_relaxed);
+        bool same = ((check ^ data) == key);
+        if (same || dataBound(data) == BOUND_NONE) {
+            // Keep the old best move if this search did not find one.
+            if (same && move < 0) move = dataMove(data);
+            replace = &slot;
+            break;
+        }
+
+        // Entries lose the equivalent of two plies per search since they
+        // were written.
+        int value = dataDepth(data) - 2 * (uint8_t) (age - dataAge(data));
+        if (value < worst) {
+            worst = value;
+            replace = &slot;
+        }
+    }
+
+    uint64_t data = pack(score, depth, bound, move, age);
+    replace->check.store(key ^ data, memory_order_relaxed);
+    replace->data.store(data, memory_order_relaxed);
+}
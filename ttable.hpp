@@ -0,0 +1,64 @@
+#ifndef __TTABLE_H__
+#define __TTABLE_H__
+
+#include <cstdint>
+#include <atomic>
+#include "common.hpp"
+using namespace std;
+
+// What a stored score says about the true value of a position.
+enum Bound {
+    BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT
+};
+
+/*
+ * One remembered search result, as returned by a probe.
+ */
+struct TTEntry {
+    int score;
+    int depth;
+    Bound bound;
+    int move;
+};
+
+/*
+ * A stored entry: 8 bytes of packed result data and the position key XOR-ed
+ * with that data. Threads read and write slots without locking; a slot torn
+ * by two simultaneous writes no longer matches its key and is ignored.
+ */
+struct TTSlot {
+    atomic<uint64_t> check;
+    atomic<uint64_t> data;
+};
+
+// Four slots fill one 64-byte cache line.
+struct TTBucket {
+    TTSlot slots[4];
+};
+
+/*
+ * Fixed-size hash table of search results, indexed by Zobrist hash and shared
+ * by all search threads. Each key maps to a bucket of four entries; when the
+ * bucket is full, the entry that is shallowest after allowing for age
+ * (searches since it was written) is replaced.
+ */
+class TranspositionTable {
+
+private:
+    TTBucket *buckets;
+    uint64_t mask;
+    uint8_t age;
+
+public:
+    TranspositionTable(int sizeMB);
+    ~TranspositionTable();
+
+    void resize(int sizeMB);
+    void clear();
+    void newSearch();
+
+    bool probe(uint64_t key, TTEntry &entry);
+    void store(uint64_t key, int depth, int score, Bound bound, int move);
+};
+
+#endif
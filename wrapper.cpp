@@ -2,12 +2,26 @@
 #include <cstdlib>
 #include <cstring>
 #include "player.hpp"
+#include "analysis.hpp"
+#include "server.hpp"
 using namespace std;
 
 int main(int argc, char *argv[]) {
+    // Analyse positions from stdin instead of playing a game.
+    if (argc >= 2 && !strcmp(argv[1], "analyze")) {
+        return analysisMain(argc, argv);
+    }
+
+    // Play many games at once, each named in the commands.
+    if (argc >= 2 && !strcmp(argv[1], "serve")) {
+        return serverMain(argc, argv);
+    }
+
     // Read in side the player is on.
     if (argc != 2)  {
         cerr << "usage: " << argv[0] << " side" << endl;
+        cerr << "       " << argv[0] << " analyze [options]" << endl;
+        cerr << "       " << argv[0] << " serve [options]" << endl;
         exit(-1);
     }
     Side side = (!strcmp(argv[1], "Black")) ? BLACK : WHITE;
@@ -15,6 +29,15 @@ int main(int argc, char *argv[]) {
     // Initialize player.
     Player *player = new Player(side);
 
+    // Search statistics (in builds with them) go to stderr, which the Java
+    // framework passes through, or to the descriptor in OTHELLO_STATS_FD.
+    const char *statsFd = getenv("OTHELLO_STATS_FD");
+    player->statsFd = statsFd ? atoi(statsFd) : 2;
+
+    // Think on the opponent's time unless OTHELLO_PONDER=0.
+    const char *ponder = getenv("OTHELLO_PONDER");
+    player->ponder = !(ponder && !strcmp(ponder, "0"));
+
     // Tell java wrapper that we are done initializing.
     cout << "Init done" << endl;
     cout.flush();
@@ -31,7 +54,7 @@ int main(int argc, char *argv[]) {
         // Get player's move and output to java wrapper.
         Move *playersMove = player->doMove(opponentsMove, msLeft);
         if (playersMove != nullptr) {
-            cout << playersMove->x << " " << playersMove->y << endl;
+            cout << playersMove->getX() << " " << playersMove->getY() << endl;
         } else {
             cout << "-1 -1" << endl;
         }
@@ -43,5 +66,6 @@ int main(int argc, char *argv[]) {
         if (playersMove != nullptr) delete playersMove;
     }
 
+    delete player;
     return 0;
 }